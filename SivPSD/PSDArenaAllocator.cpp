@@ -0,0 +1,98 @@
+﻿#include "stdafx.h"
+#include "PSDArenaAllocator.h"
+
+namespace SivPSD
+{
+	ArenaAllocator::ArenaAllocator(size_t chunkBytes) : m_chunkBytes(chunkBytes)
+	{
+	}
+
+	ArenaAllocator::~ArenaAllocator()
+	{
+		release();
+	}
+
+	void ArenaAllocator::reset(size_t retainBytes)
+	{
+		size_t capacity = 0;
+		for (const auto& chunk : m_chunks) capacity += chunk.size;
+
+		// 複数のチャンクにまたがった場合は1つにまとめ直す
+		if (m_chunks.size() > 1 || capacity > retainBytes)
+		{
+			release();
+			if (capacity <= retainBytes) m_chunks.push_back({static_cast<uint8*>(std::malloc(capacity)), capacity});
+			if (not m_chunks.empty() && not m_chunks[0].data) m_chunks.clear();
+		}
+
+		m_offset = 0;
+		m_lastBlock = nullptr;
+		m_used = 0;
+	}
+
+	void ArenaAllocator::release()
+	{
+		for (const auto& chunk : m_chunks) std::free(chunk.data);
+		m_chunks.clear();
+		m_offset = 0;
+		m_lastBlock = nullptr;
+		m_used = 0;
+	}
+
+	size_t ArenaAllocator::usedBytes() const noexcept
+	{
+		return m_used;
+	}
+
+	size_t ArenaAllocator::peakBytes() const noexcept
+	{
+		return m_peak;
+	}
+
+	void ArenaAllocator::resetPeak() noexcept
+	{
+		m_peak = m_used;
+	}
+
+	void* ArenaAllocator::DoAllocate(size_t size, size_t alignment)
+	{
+		alignment = Max(alignment, alignof(std::max_align_t));
+
+		const auto alignedOffset = [&](const Chunk& chunk, size_t offset)
+		{
+			const uintptr_t address = reinterpret_cast<uintptr_t>(chunk.data) + offset;
+			return offset + ((alignment - address % alignment) % alignment);
+		};
+
+		if (m_chunks.empty() || alignedOffset(m_chunks.back(), m_offset) + size > m_chunks.back().size)
+		{
+			const size_t chunkSize = Max(m_chunkBytes, size + alignment);
+			uint8* data = static_cast<uint8*>(std::malloc(chunkSize));
+			if (not data) return nullptr;
+			m_chunks.push_back({data, chunkSize});
+			m_offset = 0;
+		}
+
+		const Chunk& chunk = m_chunks.back();
+		const size_t begin = alignedOffset(chunk, m_offset);
+		m_lastBlock = chunk.data + begin;
+		m_lastOffset = m_offset;
+		m_lastUsed = m_used;
+
+		m_used += begin + size - m_offset;
+		m_offset = begin + size;
+		m_peak = Max(m_peak, m_used);
+		return m_lastBlock;
+	}
+
+	void ArenaAllocator::DoFree(void* block)
+	{
+		// 一時的な確保と解放が対になる場合は領域を使い回す
+		if (block && block == m_lastBlock)
+		{
+			m_offset = m_lastOffset;
+			m_used = m_lastUsed;
+			m_lastBlock = nullptr;
+		}
+	}
+}
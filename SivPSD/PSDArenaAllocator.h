@@ -0,0 +1,62 @@
+﻿#pragma once
+#include "Psd/Psd.h"
+#include "Psd/PsdAllocator.h"
+
+namespace SivPSD
+{
+	/// @brief 確保を先頭から詰めていき、reset() でまとめて解放する psd::Allocator
+	/// @remark Free は直前の確保の場合のみ領域を戻し、それ以外は reset() まで保持します。複数スレッドから同時に使うことはできません
+	class ArenaAllocator final : public psd::Allocator
+	{
+	public:
+		/// @param chunkBytes 1度にシステムから確保する最小バイト数
+		explicit ArenaAllocator(size_t chunkBytes);
+
+		~ArenaAllocator() override;
+
+		ArenaAllocator(const ArenaAllocator&) = delete;
+
+		ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+		/// @brief すべての確保を無効にします (次回は今回の量を1つのチャンクで確保できるよう、retainBytes までの領域を残します)
+		void reset(size_t retainBytes);
+
+		/// @brief すべての確保を無効にし、領域をシステムに返します
+		void release();
+
+		/// @brief 現在確保されているバイト数
+		[[nodiscard]]
+		size_t usedBytes() const noexcept;
+
+		/// @brief 作成後、または最後の resetPeak() 以降の usedBytes() の最大
+		[[nodiscard]]
+		size_t peakBytes() const noexcept;
+
+		void resetPeak() noexcept;
+
+	private:
+		struct Chunk
+		{
+			uint8* data{};
+			size_t size{};
+		};
+
+		void* DoAllocate(size_t size, size_t alignment) override;
+
+		void DoFree(void* block) override;
+
+		size_t m_chunkBytes;
+
+		/// @brief 末尾のチャンクから確保する
+		Array<Chunk> m_chunks{};
+		size_t m_offset{};
+
+		/// @brief 直前の確保 (Free された場合に領域を戻す)
+		void* m_lastBlock{};
+		size_t m_lastOffset{};
+		size_t m_lastUsed{};
+
+		size_t m_used{};
+		size_t m_peak{};
+	};
+}
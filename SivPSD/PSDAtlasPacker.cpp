@@ -0,0 +1,129 @@
+﻿#include "stdafx.h"
+#include "PSDAtlasPacker.h"
+
+namespace SivPSD
+{
+	AtlasPacker::AtlasPacker(const Size& pageSize, int32 padding) :
+		m_pageSize(pageSize),
+		m_padding(Max(padding, 0))
+	{
+	}
+
+	Array<Optional<AtlasPacker::Placement>> AtlasPacker::pack(const Array<Size>& sizes)
+	{
+		Array<Optional<Placement>> placements(sizes.size());
+
+		// 高いものから順に配置すると、スカイラインの段差が少なくなる
+		Array<size_t> order(sizes.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+		{
+			if (sizes[a].y != sizes[b].y) return sizes[a].y > sizes[b].y;
+			return sizes[a].x > sizes[b].x;
+		});
+
+		for (const size_t i : order)
+		{
+			const Size paddedSize = sizes[i] + Size{m_padding, m_padding};
+			if (sizes[i].x <= 0 || sizes[i].y <= 0) continue;
+			if (paddedSize.x > m_pageSize.x || paddedSize.y > m_pageSize.y) continue;
+
+			// 既存のページに入らなければ新しいページを作る
+			for (int32 page = 0; ; ++page)
+			{
+				if (page == pageCount())
+				{
+					m_pages.push_back(Page{.skyline = {SkylineNode{0, 0, m_pageSize.x}}});
+				}
+				if (const auto pos = insert(m_pages[page], paddedSize))
+				{
+					placements[i] = Placement{page, *pos};
+					break;
+				}
+			}
+		}
+
+		return placements;
+	}
+
+	int32 AtlasPacker::pageCount() const noexcept
+	{
+		return static_cast<int32>(m_pages.size());
+	}
+
+	Size AtlasPacker::usedSize(int32 page) const
+	{
+		return m_pages[page].usedSize;
+	}
+
+	Optional<Point> AtlasPacker::insert(Page& page, const Size& size) const
+	{
+		auto& skyline = page.skyline;
+
+		// 配置後の下端が最も上になり、同じなら最も幅の狭い線分の上に置く
+		Optional<size_t> bestIndex{};
+		Point bestPos{};
+		int32 bestBottom = std::numeric_limits<int32>::max();
+		int32 bestWidth = std::numeric_limits<int32>::max();
+		for (size_t i = 0; i < skyline.size(); ++i)
+		{
+			const int32 x = skyline[i].x;
+			if (x + size.x > m_pageSize.x) break;
+
+			// 矩形の幅にかかる線分のうち最も低い位置に合わせる
+			int32 y = 0;
+			int32 remaining = size.x;
+			for (size_t j = i; remaining > 0; ++j)
+			{
+				y = Max(y, skyline[j].y);
+				remaining -= skyline[j].width;
+			}
+			if (y + size.y > m_pageSize.y) continue;
+
+			const int32 bottom = y + size.y;
+			if (bottom < bestBottom || (bottom == bestBottom && skyline[i].width < bestWidth))
+			{
+				bestIndex = i;
+				bestPos = {x, y};
+				bestBottom = bottom;
+				bestWidth = skyline[i].width;
+			}
+		}
+		if (not bestIndex) return none;
+
+		// 新しい線分を挿入し、その下に隠れた線分を削る
+		const size_t index = *bestIndex;
+		skyline.insert(skyline.begin() + index, SkylineNode{bestPos.x, bestPos.y + size.y, size.x});
+		for (size_t i = index + 1; i < skyline.size();)
+		{
+			const int32 shrink = skyline[i - 1].x + skyline[i - 1].width - skyline[i].x;
+			if (shrink <= 0) break;
+			if (skyline[i].width <= shrink)
+			{
+				skyline.erase(skyline.begin() + i);
+				continue;
+			}
+			skyline[i].x += shrink;
+			skyline[i].width -= shrink;
+			break;
+		}
+
+		// 同じ高さで隣り合う線分をまとめる
+		for (size_t i = 0; i + 1 < skyline.size();)
+		{
+			if (skyline[i].y == skyline[i + 1].y)
+			{
+				skyline[i].width += skyline[i + 1].width;
+				skyline.erase(skyline.begin() + i + 1);
+				continue;
+			}
+			++i;
+		}
+
+		page.usedSize = {
+			Max(page.usedSize.x, Min(bestPos.x + size.x, m_pageSize.x)),
+			Max(page.usedSize.y, Min(bestPos.y + size.y, m_pageSize.y))
+		};
+		return bestPos;
+	}
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+namespace SivPSD
+{
+	/// @brief 矩形を複数のアトラスページへ詰め込むスカイライン法 (bottom-left) のパッカー
+	class AtlasPacker
+	{
+	public:
+		/// @brief 矩形の配置先
+		struct Placement
+		{
+			/// @brief ページ番号
+			int32 page{};
+
+			/// @brief ページ内の左上座標
+			Point pos{};
+		};
+
+		/// @param pageSize ページの大きさ
+		/// @param padding 隣り合う矩形の間に空ける画素数 (テクスチャのフィルタリングによるにじみを防ぎます)
+		AtlasPacker(const Size& pageSize, int32 padding);
+
+		/// @brief 矩形をまとめて詰め込みます (高さの大きい順に配置するため、まとめて渡すほど効率が良くなります)
+		/// @return sizes と同じ順の配置先 (ページに収まらない大きさの場合は none)
+		[[nodiscard]]
+		Array<Optional<Placement>> pack(const Array<Size>& sizes);
+
+		/// @brief 作成されたページ数
+		[[nodiscard]]
+		int32 pageCount() const noexcept;
+
+		/// @brief ページ内で実際に使われている範囲 (右下端)
+		[[nodiscard]]
+		Size usedSize(int32 page) const;
+
+	private:
+		/// @brief スカイラインを構成する水平な線分
+		struct SkylineNode
+		{
+			int32 x{};
+			int32 y{};
+			int32 width{};
+		};
+
+		struct Page
+		{
+			Array<SkylineNode> skyline{};
+			Size usedSize{};
+		};
+
+		/// @brief ページ内に size の矩形を配置し、その座標を返します (空きがない場合は none)
+		Optional<Point> insert(Page& page, const Size& size) const;
+
+		Size m_pageSize{};
+		int32 m_padding{};
+		Array<Page> m_pages{};
+	};
+}
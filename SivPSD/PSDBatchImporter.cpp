@@ -0,0 +1,198 @@
+﻿#include "stdafx.h"
+#include "PSDBatchImporter.h"
+#include "PSDImportScheduler.h"
+
+struct SivPSD::PSDBatchImporter::Impl
+{
+	/// @brief 完了して取り出されるのを待っているファイル
+	struct Completed
+	{
+		Result result{};
+
+		/// @brief 取り出されたときにメモリの上限へ返すバイト数
+		size_t heldBytes{};
+	};
+
+	Config m_config{};
+	std::shared_ptr<PSDWorkerPool> m_pool{};
+	std::unique_ptr<MemoryBudget> m_memoryBudget{};
+	std::atomic<bool> m_cancelled{};
+
+	Array<PSDImporter> m_importers{};
+
+	mutable std::mutex m_mutex{};
+	std::condition_variable m_completedChanged{};
+	std::deque<Completed> m_completed{};
+	size_t m_completedCount{};
+	size_t m_poppedCount{};
+
+	~Impl()
+	{
+		// 取り出されていない画素を上限から外し、保留中のファイルを (取り消された状態で) 進める
+		m_cancelled = true;
+		std::unique_lock lock{m_mutex};
+		releaseCompleted(lock);
+		m_completedChanged.wait(lock, [&]() { return m_completedCount == m_importers.size(); });
+		releaseCompleted(lock);
+		lock.unlock();
+
+		// 自前のワーカーであれば、インポーターに触れなくなるまで終了を待ってから破棄する
+		m_pool.reset();
+		m_importers.clear();
+	}
+
+	void start(const Array<PSDImporter::Config>& configs)
+	{
+		m_pool = m_config.workerPool ? m_config.workerPool : std::make_shared<PSDWorkerPool>(m_config.threadCount);
+		if (m_config.memoryBudget != 0) m_memoryBudget = std::make_unique<MemoryBudget>(m_config.memoryBudget);
+
+		m_importers.reserve(configs.size());
+		for (size_t index = 0; index < configs.size(); ++index)
+		{
+			PSDImporter::Config config = configs[index];
+			config.maxThreads = m_pool->threadCount();
+			config.asyncStart = true;
+			config.lazyDecode = false;
+			config.watchFile = false;
+
+			auto scheduler = std::make_unique<ImportScheduler>();
+			scheduler->pool = &m_pool->workers();
+			scheduler->memoryBudget = m_memoryBudget.get();
+			scheduler->cancelled = &m_cancelled;
+			scheduler->onFinished = [this, index, filepath = config.filepath](
+				PSDObject&& object, Optional<PSDError> error, ImportStats&& stats, size_t heldBytes)
+			{
+				complete({
+					.result = {
+						.index = index,
+						.filepath = filepath,
+						.object = std::move(object),
+						.error = std::move(error),
+						.stats = std::move(stats),
+					},
+					.heldBytes = heldBytes,
+				});
+			};
+			m_importers.push_back(PSDImporter{config, std::move(scheduler)});
+		}
+	}
+
+	void complete(Completed&& completed)
+	{
+		if (m_cancelled)
+		{
+			release(completed.heldBytes);
+			completed = {};
+		}
+
+		// 待っている側が破棄を始めるのはロックを離した後
+		std::lock_guard lock{m_mutex};
+		if (not m_cancelled) m_completed.push_back(std::move(completed));
+		++m_completedCount;
+		m_completedChanged.notify_all();
+	}
+
+	Optional<Result> tryPop()
+	{
+		std::unique_lock lock{m_mutex};
+		return popLocked(lock);
+	}
+
+	Optional<Result> pop()
+	{
+		std::unique_lock lock{m_mutex};
+		m_completedChanged.wait(lock, [&]()
+		{
+			return not m_completed.empty() || m_poppedCount == m_importers.size();
+		});
+		return popLocked(lock);
+	}
+
+	size_t completedCount() const
+	{
+		std::lock_guard lock{m_mutex};
+		return m_completedCount;
+	}
+
+private:
+	Optional<Result> popLocked(std::unique_lock<std::mutex>& lock)
+	{
+		if (m_completed.empty()) return none;
+
+		Completed completed = std::move(m_completed.front());
+		m_completed.pop_front();
+		++m_poppedCount;
+
+		// 上限から外すと保留中のファイルが投入されるため、ロックの外で行う
+		lock.unlock();
+		release(completed.heldBytes);
+		return std::move(completed.result);
+	}
+
+	void releaseCompleted(std::unique_lock<std::mutex>& lock)
+	{
+		std::deque<Completed> completed = std::move(m_completed);
+		m_completed.clear();
+		lock.unlock();
+		for (const auto& c : completed) release(c.heldBytes);
+		lock.lock();
+	}
+
+	void release(size_t bytes)
+	{
+		if (m_memoryBudget && bytes != 0) m_memoryBudget->release(bytes);
+	}
+};
+
+namespace SivPSD
+{
+	PSDBatchImporter::PSDBatchImporter(const Array<FilePath>& filepaths) : PSDBatchImporter(filepaths, Config())
+	{
+	}
+
+	PSDBatchImporter::PSDBatchImporter(const Array<FilePath>& filepaths, const Config& config) :
+		PSDBatchImporter(filepaths.map([](const FilePath& filepath)
+		{
+			return PSDImporter::Config{.filepath = filepath};
+		}), config)
+	{
+	}
+
+	PSDBatchImporter::PSDBatchImporter(const Array<PSDImporter::Config>& configs) : PSDBatchImporter(configs, Config())
+	{
+	}
+
+	PSDBatchImporter::PSDBatchImporter(const Array<PSDImporter::Config>& configs, const Config& config) :
+		p_impl(std::make_unique<Impl>())
+	{
+		p_impl->m_config = config;
+		p_impl->start(configs);
+	}
+
+	PSDBatchImporter::~PSDBatchImporter() = default;
+
+	Optional<PSDBatchImporter::Result> PSDBatchImporter::tryPop()
+	{
+		return p_impl->tryPop();
+	}
+
+	Optional<PSDBatchImporter::Result> PSDBatchImporter::pop()
+	{
+		return p_impl->pop();
+	}
+
+	size_t PSDBatchImporter::completedCount() const noexcept
+	{
+		return p_impl->completedCount();
+	}
+
+	size_t PSDBatchImporter::size() const noexcept
+	{
+		return p_impl->m_importers.size();
+	}
+
+	bool PSDBatchImporter::isDone() const noexcept
+	{
+		return completedCount() == size();
+	}
+}
@@ -0,0 +1,80 @@
+﻿#pragma once
+#include "PSDImporter.h"
+
+namespace SivPSD
+{
+	/// @brief 複数の PSD ファイルのレイヤーを1つの共有のワーカーで展開し、完了したものから順に受け取る
+	class PSDBatchImporter
+	{
+	public:
+		struct Config
+		{
+			/// @brief 共有のワーカー数 (0 の場合は論理コア数。workerPool を指定した場合は無視されます)
+			int32 threadCount = 0;
+
+			/// @brief 既存のワーカーで読み込む場合に指定します (nullptr の場合は threadCount のワーカーを作ります)
+			std::shared_ptr<PSDWorkerPool> workerPool{};
+
+			/// @brief 展開中の作業用メモリと、まだ取り出されていない画素の合計の上限バイト数 (0 の場合は無制限)
+			/// @remark 1ファイルで上限を超える場合は、他に確保しているファイルがなくなってから読み込みます
+			size_t memoryBudget = 2048ull * 1024 * 1024;
+		};
+
+		/// @brief 読み込みが完了したファイル
+		struct Result
+		{
+			/// @brief 渡したファイルの番号
+			size_t index{};
+
+			FilePath filepath{};
+
+			PSDObject object{};
+
+			/// @brief ファイル読み込み時などで発生したエラー (none の場合でもレイヤー単体にはエラーが含まれている可能性があります)
+			Optional<PSDError> error{};
+
+			/// @brief 読み込みの計測結果 (PSDImporter::Config::collectStats が true の場合のみ)
+			ImportStats stats{};
+		};
+
+		/// @brief 既定の設定でファイルを読み込みます
+		explicit PSDBatchImporter(const Array<FilePath>& filepaths);
+		PSDBatchImporter(const Array<FilePath>& filepaths, const Config& config);
+
+		/// @brief ファイルごとの設定で読み込みます (lazyDecode, asyncStart, watchFile は無視され、maxThreads は共有のワーカー数になります)
+		explicit PSDBatchImporter(const Array<PSDImporter::Config>& configs);
+		PSDBatchImporter(const Array<PSDImporter::Config>& configs, const Config& config);
+
+		/// @brief 開始していないファイルは読み込まず、読み込み中のファイルが終わるまで待ちます
+		~PSDBatchImporter();
+
+		PSDBatchImporter(const PSDBatchImporter&) = delete;
+
+		PSDBatchImporter& operator=(const PSDBatchImporter&) = delete;
+
+		/// @brief 完了したファイルを完了した順に取り出します (取り出せるものがない場合は none)
+		/// @remark 取り出したファイルの画素はメモリの上限から外れます
+		[[nodiscard]]
+		Optional<Result> tryPop();
+
+		/// @brief 完了したファイルを取り出せるまで待ちます (すべて取り出し済みの場合は none)
+		[[nodiscard]]
+		Optional<Result> pop();
+
+		/// @brief 読み込みが完了したファイル数 (取り出し済みを含む)
+		[[nodiscard]]
+		size_t completedCount() const noexcept;
+
+		/// @brief 渡したファイル数
+		[[nodiscard]]
+		size_t size() const noexcept;
+
+		/// @brief すべてのファイルの読み込みが完了しているか
+		[[nodiscard]]
+		bool isDone() const noexcept;
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> p_impl;
+	};
+}
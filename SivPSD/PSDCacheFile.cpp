@@ -0,0 +1,389 @@
+﻿#include "stdafx.h"
+#include "PSDCacheFile.h"
+#include "PSDKernel.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#if SIV3D_PLATFORM(WINDOWS)
+#include <Siv3D/Windows/Windows.hpp>
+#endif
+
+namespace
+{
+	using namespace SivPSD;
+
+	constexpr std::array<char, 8> CacheMagic{'S', 'I', 'V', 'P', 'S', 'D', 'C', '\0'};
+	constexpr uint32 CacheVersion = 5;
+
+	/// @brief 画素はこの境界に揃えて配置する
+	constexpr uint64 PixelAlignment = 64;
+
+	// すべてリトルエンディアンの固定長で書き出す
+	struct FileHeader
+	{
+		std::array<char, 8> magic{};
+		uint32 version{};
+		uint32 layerCount{};
+		uint64 fileSize{};
+		int64 writeTime{};
+		uint64 contentHash{};
+		uint32 marginRemove{};
+		int32 documentWidth{};
+		int32 documentHeight{};
+		uint32 bakedMasks{};
+		uint32 dithered{};
+	};
+
+	/// @brief レイヤー1つ分の情報 (直後に UTF-8 の名前とエラー文字列が続く)
+	struct LayerRecord
+	{
+		int32 id{};
+		int32 parentId{};
+		int32 clippingBaseId{};
+		int32 sharedTextureId{};
+		uint8 isFolder{};
+		uint8 isVisible{};
+		uint8 opacity{};
+		uint8 blendMode{};
+		uint8 isBlank{};
+		int32 regionX{};
+		int32 regionY{};
+		int32 regionWidth{};
+		int32 regionHeight{};
+		int32 imageWidth{};
+		int32 imageHeight{};
+		uint64 pixelOffset{};
+		uint32 nameBytes{};
+		uint32 errorBytes{};
+	};
+
+	static_assert(std::is_trivially_copyable_v<FileHeader> && std::is_trivially_copyable_v<LayerRecord>);
+
+	uint64 alignPixelOffset(uint64 offset)
+	{
+		return (offset + PixelAlignment - 1) / PixelAlignment * PixelAlignment;
+	}
+
+	int64 packDateTime(const DateTime& t)
+	{
+		return (((((static_cast<int64>(t.year) * 13 + t.month) * 32 + t.day) * 24 + t.hour) * 60 + t.minute) * 60
+			+ t.second) * 1000 + t.milliseconds;
+	}
+
+	std::filesystem::path toNativePath(const FilePath& path)
+	{
+		const std::string utf8 = path.toUTF8();
+		return std::filesystem::path{std::u8string{utf8.begin(), utf8.end()}};
+	}
+
+	/// @brief キャッシュファイルのヘッダーのみを読む (読めない場合や版が異なる場合は none)
+	Optional<FileHeader> readFileHeader(const FilePath& cachePath)
+	{
+		BinaryReader reader{cachePath};
+		FileHeader header{};
+		if (not reader || not reader.read(header)) return none;
+		if (header.magic != CacheMagic || header.version != CacheVersion) return none;
+		return header;
+	}
+
+	/// @brief 内容が同じまま更新日時だけが変わった場合に、次回からハッシュを計算せずに済むようヘッダーの更新日時を書き換える
+	void updateWriteTime(const FilePath& cachePath, int64 writeTime)
+	{
+		std::fstream file{toNativePath(cachePath), std::ios::in | std::ios::out | std::ios::binary};
+		if (not file) return;
+		file.seekp(offsetof(FileHeader, writeTime));
+		file.write(reinterpret_cast<const char*>(&writeTime), sizeof(writeTime));
+	}
+
+	/// @brief 一時ファイルで既存のファイルを置き換える (途中で失敗しても、どちらかのファイルが必ず残る)
+	bool replaceFile(const FilePath& from, const FilePath& to)
+	{
+#if SIV3D_PLATFORM(WINDOWS)
+		return ::MoveFileExW(Unicode::ToWstring(from).c_str(), Unicode::ToWstring(to).c_str(),
+		                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		return std::rename(from.toUTF8().c_str(), to.toUTF8().c_str()) == 0;
+#endif
+	}
+
+	/// @brief マップされた領域を範囲を確認しながら読み進める
+	class ByteCursor
+	{
+	public:
+		ByteCursor(const uint8* data, uint64 size) : m_data(data), m_size(size)
+		{
+		}
+
+		template <class T>
+		bool read(T& value)
+		{
+			if (m_size - m_position < sizeof(T)) return false;
+			std::memcpy(&value, m_data + m_position, sizeof(T));
+			m_position += sizeof(T);
+			return true;
+		}
+
+		bool readString(uint32 bytes, String& value)
+		{
+			if (m_size - m_position < bytes) return false;
+			value = Unicode::FromUTF8(std::string_view(reinterpret_cast<const char*>(m_data + m_position), bytes));
+			m_position += bytes;
+			return true;
+		}
+
+	private:
+		const uint8* m_data;
+		uint64 m_size;
+		uint64 m_position{};
+	};
+}
+
+namespace SivPSD::CacheFile
+{
+	Optional<SourceKey> MakeSourceKey(
+		const FilePath& sourcePath, const FilePath& cachePath, bool marginRemove, uint32 bakedMasks, bool dither)
+	{
+		const auto writeTime = FileSystem::WriteTime(sourcePath);
+		if (not writeTime) return none;
+
+		// ディザは 16/32 ビットのドキュメントの画素のみを変える (ビット深度はファイルヘッダーの 22 バイト目から)
+		uint32 depth = 8;
+		{
+			BinaryReader reader{sourcePath};
+			if (not reader) return none;
+			std::array<uint8, 24> fileHeader{};
+			if (reader.read(fileHeader.data(), fileHeader.size()) == static_cast<int64>(fileHeader.size()))
+			{
+				depth = (static_cast<uint32>(fileHeader[22]) << 8) | fileHeader[23];
+			}
+		}
+
+		SourceKey key{
+			.fileSize = static_cast<uint64>(FileSystem::FileSize(sourcePath)),
+			.writeTime = packDateTime(*writeTime),
+			.marginRemove = marginRemove,
+			.bakedMasks = bakedMasks,
+			.dithered = dither && depth > 8,
+		};
+
+		// 大きさと更新日時がキャッシュファイルと一致すれば、内容は変わっていないとみなす
+		const auto cachedHeader = readFileHeader(cachePath);
+		if (cachedHeader && cachedHeader->fileSize == key.fileSize && cachedHeader->writeTime == key.writeTime)
+		{
+			key.contentHash = cachedHeader->contentHash;
+			return key;
+		}
+
+		psd::MallocAllocator allocator{};
+		MappedFile file{&allocator};
+		const std::wstring path = Unicode::ToWstring(sourcePath);
+		if (not file.OpenRead(path.c_str())) return none;
+		key.fileSize = file.size();
+		key.contentHash = Kernel::Hash64(file.data(), static_cast<size_t>(file.size()));
+		file.Close();
+
+		if (cachedHeader && cachedHeader->fileSize == key.fileSize && cachedHeader->contentHash == key.contentHash)
+		{
+			updateWriteTime(cachePath, key.writeTime);
+		}
+		return key;
+	}
+
+	FilePath GetCacheFilePath(const FilePath& sourcePath, const FilePath& cacheDirectory)
+	{
+		if (cacheDirectory.isEmpty()) return sourcePath + U".sivpsdcache";
+
+		// 別ディレクトリの同名ファイルと衝突しないよう、フルパスのハッシュを付ける
+		const String fullPath = FileSystem::FullPath(sourcePath);
+		const uint64 pathHash = Kernel::Hash64(fullPath.data(), fullPath.size() * sizeof(char32));
+		return FileSystem::PathAppend(
+			cacheDirectory, U"{}_{:016X}.sivpsdcache"_fmt(FileSystem::FileName(sourcePath), pathHash));
+	}
+
+	bool Write(const FilePath& cachePath, const SourceKey& key, const PSDObject& object)
+	{
+		// レイヤー情報を先にまとめ、画素の配置を決める
+		Array<LayerRecord> records(object.layers.size());
+		Array<std::string> names(object.layers.size());
+		Array<std::string> errors(object.layers.size());
+		uint64 metadataBytes = sizeof(FileHeader);
+		for (size_t i = 0; i < object.layers.size(); ++i)
+		{
+			const auto& layer = object.layers[i];
+			names[i] = layer.name.toUTF8();
+			if (layer.error) errors[i] = layer.error->what().toUTF8();
+			records[i] = {
+				.id = layer.id,
+				.parentId = layer.parentId.value_or(-1),
+				.clippingBaseId = layer.clippingBaseId.value_or(-1),
+				.sharedTextureId = layer.sharedTextureId.value_or(-1),
+				.isFolder = static_cast<uint8>(layer.isFolder),
+				.isVisible = static_cast<uint8>(layer.isVisible),
+				.opacity = layer.opacity,
+				.blendMode = static_cast<uint8>(layer.blendMode),
+				.isBlank = static_cast<uint8>(layer.isBlank),
+				.regionX = layer.region.x,
+				.regionY = layer.region.y,
+				.regionWidth = layer.region.w,
+				.regionHeight = layer.region.h,
+				.imageWidth = layer.image.width(),
+				.imageHeight = layer.image.height(),
+				.nameBytes = static_cast<uint32>(names[i].size()),
+				.errorBytes = static_cast<uint32>(errors[i].size()),
+			};
+			metadataBytes += sizeof(LayerRecord) + names[i].size() + errors[i].size();
+		}
+
+		uint64 offset = alignPixelOffset(metadataBytes);
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			if (object.layers[i].image.isEmpty()) continue;
+			records[i].pixelOffset = offset;
+			offset = alignPixelOffset(offset + object.layers[i].image.size_bytes());
+		}
+
+		const FileHeader header{
+			.magic = CacheMagic,
+			.version = CacheVersion,
+			.layerCount = static_cast<uint32>(object.layers.size()),
+			.fileSize = key.fileSize,
+			.writeTime = key.writeTime,
+			.contentHash = key.contentHash,
+			.marginRemove = key.marginRemove,
+			.documentWidth = object.documentSize.x,
+			.documentHeight = object.documentSize.y,
+			.bakedMasks = key.bakedMasks,
+			.dithered = key.dithered,
+		};
+
+		// 書き込み途中のファイルを読まないよう、一時ファイルに書いてから置き換える
+		const FilePath tempPath = cachePath + U".tmp";
+		bool written = false;
+		{
+			BinaryWriter writer{tempPath};
+			if (not writer) return false;
+
+			const auto write = [&](const void* data, uint64 bytes)
+			{
+				return writer.write(data, static_cast<int64>(bytes)) == static_cast<int64>(bytes);
+			};
+
+			written = write(&header, sizeof(header));
+			for (size_t i = 0; written && i < records.size(); ++i)
+			{
+				written = write(&records[i], sizeof(LayerRecord))
+					&& write(names[i].data(), names[i].size())
+					&& write(errors[i].data(), errors[i].size());
+			}
+
+			constexpr std::array<uint8, PixelAlignment> padding{};
+			uint64 position = metadataBytes;
+			for (size_t i = 0; written && i < records.size(); ++i)
+			{
+				if (records[i].pixelOffset == 0) continue;
+				const auto& image = object.layers[i].image;
+				written = write(padding.data(), records[i].pixelOffset - position)
+					&& write(image.data(), image.size_bytes());
+				position = records[i].pixelOffset + image.size_bytes();
+			}
+			writer.close();
+		}
+
+		// 書き込みに失敗した場合は、既存のキャッシュファイルを残す
+		if (written && replaceFile(tempPath, cachePath)) return true;
+		(void)FileSystem::Remove(tempPath);
+		return false;
+	}
+
+	Reader::Reader() = default;
+
+	Reader::~Reader() = default;
+
+	bool Reader::open(const FilePath& cachePath, const SourceKey& key)
+	{
+		if (not FileSystem::IsFile(cachePath)) return false;
+
+		m_file = std::make_unique<MappedFile>(&m_allocator);
+		const std::wstring path = Unicode::ToWstring(cachePath);
+		if (not m_file->OpenRead(path.c_str())) return false;
+
+		ByteCursor cursor{m_file->data(), m_file->size()};
+		FileHeader header{};
+		if (not cursor.read(header)) return false;
+		if (header.magic != CacheMagic || header.version != CacheVersion) return false;
+
+		const SourceKey cachedKey{
+			.fileSize = header.fileSize,
+			.writeTime = header.writeTime,
+			.contentHash = header.contentHash,
+			.marginRemove = header.marginRemove != 0,
+			.bakedMasks = header.bakedMasks,
+			.dithered = header.dithered != 0,
+		};
+		if (cachedKey != key) return false;
+
+		m_object.documentSize = {header.documentWidth, header.documentHeight};
+		m_object.layers.resize(header.layerCount);
+		m_imageSizes.resize(header.layerCount);
+		m_pixelOffsets.resize(header.layerCount);
+		for (uint32 i = 0; i < header.layerCount; ++i)
+		{
+			LayerRecord record{};
+			auto& layer = m_object.layers[i];
+			String error{};
+			if (not cursor.read(record)
+				|| not cursor.readString(record.nameBytes, layer.name)
+				|| not cursor.readString(record.errorBytes, error))
+			{
+				return false;
+			}
+
+			layer.id = record.id;
+			if (record.parentId >= 0) layer.parentId = record.parentId;
+			if (record.clippingBaseId >= 0) layer.clippingBaseId = record.clippingBaseId;
+			if (record.sharedTextureId >= 0 && static_cast<uint32>(record.sharedTextureId) < header.layerCount)
+			{
+				layer.sharedTextureId = record.sharedTextureId;
+			}
+			layer.isFolder = record.isFolder != 0;
+			layer.isVisible = record.isVisible != 0;
+			layer.opacity = record.opacity;
+			layer.blendMode = static_cast<PSDBlendMode>(record.blendMode);
+			layer.isBlank = record.isBlank != 0;
+			layer.region = Rect(record.regionX, record.regionY, record.regionWidth, record.regionHeight);
+			if (not error.isEmpty()) layer.error = PSDError(error);
+
+			// 画素がファイルに収まっているか確認
+			const Size imageSize{record.imageWidth, record.imageHeight};
+			const uint64 pixelBytes = static_cast<uint64>(Max(imageSize.x, 0)) * Max(imageSize.y, 0) * sizeof(Color);
+			if (pixelBytes != 0
+				&& (record.pixelOffset % PixelAlignment != 0 || record.pixelOffset > m_file->size()
+					|| m_file->size() - record.pixelOffset < pixelBytes))
+			{
+				return false;
+			}
+			m_imageSizes[i] = pixelBytes == 0 ? Size{} : imageSize;
+			m_pixelOffsets[i] = record.pixelOffset;
+		}
+
+		return true;
+	}
+
+	const PSDObject& Reader::object() const noexcept
+	{
+		return m_object;
+	}
+
+	Size Reader::imageSize(PSDLayer::id_type id) const
+	{
+		return m_imageSizes[id];
+	}
+
+	const Color* Reader::pixels(PSDLayer::id_type id) const
+	{
+		if (m_imageSizes[id] == Size{}) return nullptr;
+		return reinterpret_cast<const Color*>(m_file->data() + m_pixelOffsets[id]);
+	}
+}
@@ -0,0 +1,84 @@
+﻿#pragma once
+#include "PSDMappedFile.h"
+#include "PSDObject.h"
+
+#include "Psd/PsdMallocAllocator.h"
+
+namespace SivPSD::CacheFile
+{
+	/// @brief キャッシュファイルが元ファイルに対応しているかを判定する情報
+	struct SourceKey
+	{
+		uint64 fileSize{};
+
+		/// @brief 更新日時 (ミリ秒単位で詰めた値)
+		int64 writeTime{};
+
+		uint64 contentHash{};
+
+		/// @brief 余白を除いて格納したか (画素の矩形が変わるため)
+		bool marginRemove{};
+
+		/// @brief アルファに焼き込んだマスクの種類 (読み込み時の設定ごとのビットの組み合わせ)
+		uint32 bakedMasks{};
+
+		/// @brief 8 ビットより深いドキュメントをディザをかけて丸めたか (8 ビットのドキュメントでは常に false)
+		bool dithered{};
+
+		bool operator==(const SourceKey&) const = default;
+	};
+
+	/// @brief 元ファイルの SourceKey を作ります (開けない場合は none)
+	/// @remark 大きさと更新日時がキャッシュファイルと一致する場合は、内容のハッシュを計算せずにキャッシュファイルの値を使います。一致しない場合のみ元ファイルをメモリマップしてハッシュを計算し、内容が同じであればキャッシュファイルの更新日時を書き換えます
+	/// @param cachePath GetCacheFilePath() で求めたキャッシュファイルのパス
+	/// @param dither 8 ビットに丸める際にディザをかけるか (ファイルヘッダーのビット深度が 8 以下の場合は無視されます)
+	[[nodiscard]]
+	Optional<SourceKey> MakeSourceKey(
+		const FilePath& sourcePath, const FilePath& cachePath, bool marginRemove, uint32 bakedMasks, bool dither);
+
+	/// @brief 元ファイルに対応するキャッシュファイルのパス
+	/// @param cacheDirectory 空の場合は元ファイルと同じディレクトリ
+	[[nodiscard]]
+	FilePath GetCacheFilePath(const FilePath& sourcePath, const FilePath& cacheDirectory);
+
+	/// @brief オブジェクトのレイヤー情報と画素を書き出します (画素配列を持たないレイヤーは画素なしで書き出されます)
+	/// @return 書き出せなかった場合は false (既存のキャッシュファイルはそのまま残ります)
+	[[nodiscard]]
+	bool Write(const FilePath& cachePath, const SourceKey& key, const PSDObject& object);
+
+	/// @brief キャッシュファイルをメモリマップし、画素を展開せずに参照する
+	class Reader
+	{
+	public:
+		Reader();
+
+		~Reader();
+
+		Reader(const Reader&) = delete;
+
+		Reader& operator=(const Reader&) = delete;
+
+		/// @brief ファイルを開き、key と一致する場合のみレイヤー情報を読み込みます
+		[[nodiscard]]
+		bool open(const FilePath& cachePath, const SourceKey& key);
+
+		/// @brief 画素を含まないオブジェクト
+		[[nodiscard]]
+		const PSDObject& object() const noexcept;
+
+		/// @brief レイヤー画像の大きさ (画素を持たない場合は 0)
+		[[nodiscard]]
+		Size imageSize(PSDLayer::id_type id) const;
+
+		/// @brief 隙間なく並んだレイヤーの画素 (画素を持たない場合は nullptr)
+		[[nodiscard]]
+		const Color* pixels(PSDLayer::id_type id) const;
+
+	private:
+		psd::MallocAllocator m_allocator{};
+		std::unique_ptr<MappedFile> m_file{};
+		PSDObject m_object{};
+		Array<Size> m_imageSizes{};
+		Array<uint64> m_pixelOffsets{};
+	};
+}
@@ -0,0 +1,145 @@
+﻿#include "stdafx.h"
+#include "PSDChannelDecoder.h"
+
+namespace
+{
+	using namespace SivPSD::ChannelDecoder;
+
+	constexpr size_t compressionHeaderSize = sizeof(uint16);
+
+	// RLE の各行のバイト数 (PSD 形式では 2 バイト)
+	constexpr size_t rleRowCountSize = sizeof(uint16);
+
+	uint16 readUint16BE(const uint8* p)
+	{
+		return static_cast<uint16>((p[0] << 8) | p[1]);
+	}
+
+	/// @brief PackBits で圧縮された 1 行を展開
+	bool decodePackBitsRow(const uint8* src, size_t srcSize, uint8* dest, size_t destSize)
+	{
+		size_t in = 0;
+		size_t out = 0;
+		while (in < srcSize && out < destSize)
+		{
+			const int header = static_cast<int8>(src[in++]);
+			if (header >= 0)
+			{
+				// 続く header + 1 バイトをそのままコピー
+				const size_t length = static_cast<size_t>(header) + 1;
+				if (in + length > srcSize || out + length > destSize) return false;
+				std::memcpy(dest + out, src + in, length);
+				in += length;
+				out += length;
+			}
+			else if (header != -128)
+			{
+				// 次の 1 バイトを 1 - header 回繰り返す
+				const size_t length = static_cast<size_t>(1 - header);
+				if (in >= srcSize || out + length > destSize) return false;
+				std::memset(dest + out, src[in++], length);
+				out += length;
+			}
+		}
+		return out == destSize;
+	}
+
+	/// @brief RLE の行バイト数表の [tableBegin, tableEnd) 行を展開して dest に並べる
+	/// @param tableRows 表の行数 (圧縮データは表の直後から続く)
+	bool decodeRle(
+		const uint8* src, size_t srcSize, size_t rowBytes, size_t tableRows, size_t tableBegin, size_t tableEnd,
+		uint8* dest)
+	{
+		const size_t tableSize = tableRows * rleRowCountSize;
+		if (srcSize < tableSize) return false;
+
+		// 開始行までの圧縮後バイト数を読み飛ばす
+		size_t offset = tableSize;
+		for (size_t y = 0; y < tableBegin; ++y)
+		{
+			offset += readUint16BE(src + y * rleRowCountSize);
+		}
+
+		for (size_t y = tableBegin; y < tableEnd; ++y)
+		{
+			const size_t rowSize = readUint16BE(src + y * rleRowCountSize);
+			if (offset + rowSize > srcSize) return false;
+			if (not decodePackBitsRow(src + offset, rowSize, dest, rowBytes)) return false;
+			offset += rowSize;
+			dest += rowBytes;
+		}
+		return true;
+	}
+}
+
+namespace SivPSD::ChannelDecoder
+{
+	Optional<Compression> GetCompression(const uint8* src, size_t srcSize)
+	{
+		if (srcSize < compressionHeaderSize) return none;
+		return static_cast<Compression>(readUint16BE(src));
+	}
+
+	bool IsDecodable(Compression compression) noexcept
+	{
+		return compression == Compression::Raw || compression == Compression::Rle;
+	}
+
+	bool Decode(const uint8* src, size_t srcSize, size_t rowBytes, int rows, uint8* dest)
+	{
+		return DecodeRows(src, srcSize, rowBytes, rows, 0, rows, dest);
+	}
+
+	bool DecodeRows(const uint8* src, size_t srcSize, size_t rowBytes, int rows, int rowBegin, int rowEnd, uint8* dest)
+	{
+		if (rowBytes == 0 || rowBegin >= rowEnd) return true;
+		if (rowBegin < 0 || rows < rowEnd) return false;
+
+		const auto compression = GetCompression(src, srcSize);
+		if (not compression) return false;
+		src += compressionHeaderSize;
+		srcSize -= compressionHeaderSize;
+
+		switch (*compression)
+		{
+		case Compression::Raw:
+			if (srcSize < rowBytes * rows) return false;
+			std::memcpy(dest + rowBytes * rowBegin, src + rowBytes * rowBegin, rowBytes * (rowEnd - rowBegin));
+			return true;
+		case Compression::Rle:
+			return decodeRle(src, srcSize, rowBytes, rows, rowBegin, rowEnd, dest + rowBytes * rowBegin);
+		default:
+			return false;
+		}
+	}
+
+	bool DecodeImageDataRows(
+		const uint8* src, size_t srcSize, size_t rowBytes, int rows, int channelCount, int channel,
+		int rowBegin, int rowEnd, uint8* dest)
+	{
+		if (rowBytes == 0 || rowBegin >= rowEnd) return true;
+		if (rowBegin < 0 || rows < rowEnd || channel < 0 || channelCount <= channel) return false;
+
+		const auto compression = GetCompression(src, srcSize);
+		if (not compression) return false;
+		src += compressionHeaderSize;
+		srcSize -= compressionHeaderSize;
+
+		// チャンネルは順に並んでいるため、全チャンネルを通した行番号で扱う
+		const size_t channelRow = static_cast<size_t>(channel) * rows;
+		switch (*compression)
+		{
+		case Compression::Raw:
+			if (srcSize < rowBytes * rows * channelCount) return false;
+			std::memcpy(
+				dest + rowBytes * rowBegin, src + rowBytes * (channelRow + rowBegin), rowBytes * (rowEnd - rowBegin));
+			return true;
+		case Compression::Rle:
+			return decodeRle(
+				src, srcSize, rowBytes, static_cast<size_t>(rows) * channelCount,
+				channelRow + rowBegin, channelRow + rowEnd, dest + rowBytes * rowBegin);
+		default:
+			return false;
+		}
+	}
+}
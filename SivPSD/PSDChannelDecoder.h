@@ -0,0 +1,49 @@
+﻿#pragma once
+
+namespace SivPSD::ChannelDecoder
+{
+	/// @brief チャンネルデータの圧縮形式
+	enum class Compression : uint16
+	{
+		Raw = 0,
+		Rle = 1,
+		Zip = 2,
+		ZipWithPrediction = 3,
+	};
+
+	/// @brief チャンネルデータ先頭の圧縮形式を取得
+	/// @param src チャンネルデータ (Channel::fileOffset の位置)
+	/// @param srcSize チャンネルデータのバイト数 (Channel::size)
+	[[nodiscard]]
+	Optional<Compression> GetCompression(const uint8* src, size_t srcSize);
+
+	/// @brief Decode で展開できる圧縮形式か
+	[[nodiscard]]
+	bool IsDecodable(Compression compression) noexcept;
+
+	/// @brief 無圧縮または RLE のチャンネルデータを展開
+	/// @param src チャンネルデータ (Channel::fileOffset の位置)
+	/// @param srcSize チャンネルデータのバイト数 (Channel::size)
+	/// @param rowBytes 1行あたりのバイト数
+	/// @param rows 行数
+	/// @param dest rowBytes * rows バイトの出力先
+	/// @return 展開に成功したか
+	bool Decode(const uint8* src, size_t srcSize, size_t rowBytes, int rows, uint8* dest);
+
+	/// @brief 無圧縮または RLE のチャンネルデータのうち [rowBegin, rowEnd) 行のみを展開
+	/// @remark RLE は各行の圧縮後バイト数が先頭に並んでいるため、行の範囲ごとに独立して展開できます
+	/// @param dest rowBytes * rows バイトの出力先 (チャンネル全体の先頭)
+	/// @return 展開に成功したか
+	bool DecodeRows(const uint8* src, size_t srcSize, size_t rowBytes, int rows, int rowBegin, int rowEnd, uint8* dest);
+
+	/// @brief 画像データセクション (統合画像) のうち、1チャンネルの [rowBegin, rowEnd) 行のみを展開
+	/// @remark 統合画像の RLE は全チャンネルの各行の圧縮後バイト数が先頭にまとめて並んでいます
+	/// @param src 画像データセクションの先頭
+	/// @param channelCount 統合画像のチャンネル数
+	/// @param channel 展開するチャンネル
+	/// @param dest rowBytes * rows バイトの出力先 (チャンネル全体の先頭)
+	/// @return 展開に成功したか
+	bool DecodeImageDataRows(
+		const uint8* src, size_t srcSize, size_t rowBytes, int rows, int channelCount, int channel,
+		int rowBegin, int rowEnd, uint8* dest);
+}
@@ -0,0 +1,189 @@
+﻿#include "stdafx.h"
+#include "PSDCompositionCache.h"
+
+namespace SivPSD
+{
+	PSDCompositionCache::PSDCompositionCache() = default;
+
+	PSDCompositionCache::PSDCompositionCache(PSDObject object, const PSDCompositor::Config& config) :
+		m_object(std::move(object)),
+		m_compositor(config)
+	{
+		// ドキュメントをタイルに分割
+		const int32 tileSize = m_compositor.tileSize();
+		const Size documentSize = m_object.documentSize;
+		m_tileCount = {(documentSize.x + tileSize - 1) / tileSize, (documentSize.y + tileSize - 1) / tileSize};
+		for (int32 y = 0; y < m_tileCount.y; ++y)
+		{
+			for (int32 x = 0; x < m_tileCount.x; ++x)
+			{
+				m_tiles.emplace_back(
+					x * tileSize, y * tileSize,
+					Min(tileSize, documentSize.x - x * tileSize), Min(tileSize, documentSize.y - y * tileSize));
+			}
+		}
+		m_dirtyTiles.resize(m_tiles.size());
+
+		// レイヤーとタイルの重なり、フォルダの親子関係とクリッピングを記録
+		m_layerTiles.resize(m_object.layers.size());
+		for (const auto& layer : m_object.layers) updateLayerTiles(layer.id);
+		updateDependents();
+
+		m_image = Image(documentSize, Color(0, 0));
+		m_compositor.compositeTiles(m_object, m_tiles, m_image);
+		m_texture = DynamicTexture(m_image, TextureDesc::Unmipped);
+	}
+
+	const PSDObject& PSDCompositionCache::object() const noexcept
+	{
+		return m_object;
+	}
+
+	void PSDCompositionCache::setVisible(PSDLayer::id_type id, bool isVisible)
+	{
+		auto& layer = m_object.layers[id];
+		if (layer.isVisible == isVisible) return;
+		layer.isVisible = isVisible;
+		invalidateLayerTree(id);
+	}
+
+	void PSDCompositionCache::setOpacity(PSDLayer::id_type id, uint8 opacity)
+	{
+		auto& layer = m_object.layers[id];
+		if (layer.opacity == opacity) return;
+		layer.opacity = opacity;
+		invalidateLayerTree(id);
+	}
+
+	void PSDCompositionCache::setLayerImage(PSDLayer::id_type id, const Image& image, const Rect& region)
+	{
+		// 変更前の領域も再合成する
+		invalidateLayer(id);
+
+		auto& layer = m_object.layers[id];
+		layer.image = image;
+		layer.compressedImage = CompressedImage{};
+		layer.region = region;
+		updateLayerTiles(id);
+		invalidateLayer(id);
+	}
+
+	void PSDCompositionCache::moveLayer(PSDLayer::id_type id, PSDLayer::id_type index)
+	{
+		if (id == index) return;
+
+		// 領域は変わらないため、移動前と同じタイルのみが変わる
+		invalidateLayerTree(id);
+
+		// 移動によって位置がずれるレイヤーの ID と、それを指す参照を付け直す
+		const auto remap = [id, index](PSDLayer::id_type i)
+		{
+			if (i == id) return index;
+			if (id < i && i <= index) return i - 1;
+			if (index <= i && i < id) return i + 1;
+			return i;
+		};
+		for (auto& layer : m_object.layers)
+		{
+			layer.id = remap(layer.id);
+			if (layer.parentId) layer.parentId = remap(*layer.parentId);
+			if (layer.clippingBaseId) layer.clippingBaseId = remap(*layer.clippingBaseId);
+			if (layer.sharedTextureId) layer.sharedTextureId = remap(*layer.sharedTextureId);
+		}
+
+		const auto rotate = [id, index](auto& array)
+		{
+			if (id < index) std::rotate(array.begin() + id, array.begin() + id + 1, array.begin() + index + 1);
+			else std::rotate(array.begin() + index, array.begin() + id, array.begin() + id + 1);
+		};
+		rotate(m_object.layers);
+		rotate(m_layerTiles);
+		updateDependents();
+	}
+
+	void PSDCompositionCache::invalidateLayer(PSDLayer::id_type id)
+	{
+		for (const size_t tile : m_layerTiles[id])
+		{
+			m_dirtyTiles[tile] = true;
+			m_dirty = true;
+		}
+	}
+
+	bool PSDCompositionCache::isDirty() const noexcept
+	{
+		return m_dirty;
+	}
+
+	void PSDCompositionCache::update()
+	{
+		if (not m_dirty) return;
+
+		Array<Rect> dirtyTiles{};
+		for (size_t i = 0; i < m_tiles.size(); ++i)
+		{
+			if (not m_dirtyTiles[i]) continue;
+			dirtyTiles.push_back(m_tiles[i]);
+			m_dirtyTiles[i] = false;
+		}
+		m_dirty = false;
+
+		m_compositor.compositeTiles(m_object, dirtyTiles, m_image);
+		for (const auto& tile : dirtyTiles)
+		{
+			(void)m_texture.fillRegion(m_image, tile);
+		}
+	}
+
+	const Image& PSDCompositionCache::image() const noexcept
+	{
+		return m_image;
+	}
+
+	const DynamicTexture& PSDCompositionCache::texture() const noexcept
+	{
+		return m_texture;
+	}
+
+	void PSDCompositionCache::updateLayerTiles(PSDLayer::id_type id)
+	{
+		auto& tiles = m_layerTiles[id];
+		tiles.clear();
+
+		const auto& layer = m_object.layers[id];
+		if (layer.isFolder) return;
+
+		const int32 tileSize = m_compositor.tileSize();
+		const Point tl = Math::Max(layer.region.tl(), Point{});
+		const Point br = Math::Min(layer.region.tl() + layer.imageSize(), m_object.documentSize);
+		if (br.x <= tl.x || br.y <= tl.y) return;
+
+		for (int32 y = tl.y / tileSize; y <= (br.y - 1) / tileSize; ++y)
+		{
+			for (int32 x = tl.x / tileSize; x <= (br.x - 1) / tileSize; ++x)
+			{
+				tiles.push_back(static_cast<size_t>(y) * m_tileCount.x + x);
+			}
+		}
+	}
+
+	void PSDCompositionCache::updateDependents()
+	{
+		m_children.assign(m_object.layers.size(), {});
+		m_clippedLayers.assign(m_object.layers.size(), {});
+		for (const auto& layer : m_object.layers)
+		{
+			if (layer.parentId && *layer.parentId != layer.id) m_children[*layer.parentId].push_back(layer.id);
+			if (layer.clippingBaseId) m_clippedLayers[*layer.clippingBaseId].push_back(layer.id);
+		}
+	}
+
+	void PSDCompositionCache::invalidateLayerTree(PSDLayer::id_type id)
+	{
+		invalidateLayer(id);
+		for (const auto child : m_children[id]) invalidateLayerTree(child);
+
+		// 土台が非表示になるとクリッピングされたレイヤーも描画されない
+		for (const auto clipped : m_clippedLayers[id]) invalidateLayerTree(clipped);
+	}
+}
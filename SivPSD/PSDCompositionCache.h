@@ -0,0 +1,78 @@
+﻿#pragma once
+#include "PSDCompositor.h"
+
+namespace SivPSD
+{
+	/// @brief 合成結果をタイル単位で保持し、変更されたレイヤーと重なるタイルのみを再合成するキャッシュ
+	/// @remark 合成結果は1枚の DynamicTexture として描画できます
+	class PSDCompositionCache
+	{
+	public:
+		PSDCompositionCache();
+		explicit PSDCompositionCache(PSDObject object, const PSDCompositor::Config& config = {});
+
+		/// @brief 合成に使われているオブジェクト
+		[[nodiscard]]
+		const PSDObject& object() const noexcept;
+
+		/// @brief レイヤー (フォルダの場合は子孫も含む) の表示フラグを変更
+		void setVisible(PSDLayer::id_type id, bool isVisible);
+
+		/// @brief レイヤー (フォルダの場合は子孫も含む) の不透明度を変更
+		void setOpacity(PSDLayer::id_type id, uint8 opacity);
+
+		/// @brief レイヤーの画素と領域を差し替え
+		void setLayerImage(PSDLayer::id_type id, const Image& image, const Rect& region);
+
+		/// @brief レイヤーを配列内の index の位置 (合成順) に移動 (ID は配列内の位置のため、間にあるレイヤーの ID も 1 ずつずれます)
+		void moveLayer(PSDLayer::id_type id, PSDLayer::id_type index);
+
+		/// @brief レイヤーと重なるタイルを再合成の対象にする
+		void invalidateLayer(PSDLayer::id_type id);
+
+		/// @brief 再合成が必要なタイルがあるか
+		[[nodiscard]]
+		bool isDirty() const noexcept;
+
+		/// @brief 変更されたタイルのみを再合成し、テクスチャの該当領域を更新
+		void update();
+
+		/// @brief 合成結果の画像
+		[[nodiscard]]
+		const Image& image() const noexcept;
+
+		/// @brief 合成結果のテクスチャ
+		[[nodiscard]]
+		const DynamicTexture& texture() const noexcept;
+
+	private:
+		/// @brief レイヤー単体と重なるタイルの番号を再計算
+		void updateLayerTiles(PSDLayer::id_type id);
+
+		/// @brief フォルダの子レイヤーと、クリッピングされたレイヤーを記録し直す
+		void updateDependents();
+
+		/// @brief レイヤーとその子孫、クリッピングされたレイヤーを再合成の対象にする
+		void invalidateLayerTree(PSDLayer::id_type id);
+
+		PSDObject m_object{};
+		PSDCompositor m_compositor{};
+
+		Size m_tileCount{};
+		Array<Rect> m_tiles{};
+		Array<bool> m_dirtyTiles{};
+		bool m_dirty{};
+
+		/// @brief レイヤーごとの、重なっているタイルの番号
+		Array<Array<size_t>> m_layerTiles{};
+
+		/// @brief フォルダごとの子レイヤーの ID
+		Array<Array<PSDLayer::id_type>> m_children{};
+
+		/// @brief 土台ごとのクリッピングされたレイヤーの ID (土台の表示フラグで表示が変わる)
+		Array<Array<PSDLayer::id_type>> m_clippedLayers{};
+
+		Image m_image{};
+		DynamicTexture m_texture{};
+	};
+}
@@ -0,0 +1,132 @@
+﻿#include "stdafx.h"
+#include "PSDCompositor.h"
+#include "PSDImportScheduler.h"
+#include "PSDKernel.h"
+
+namespace
+{
+	using namespace SivPSD;
+
+	/// @brief rect と重なるレイヤーを、不透明度を適用しながら dest に下から順に合成
+	void compositeTile(
+		const PSDObject& object, const Array<uint8>& opacities, const Rect& tile, Image& dest)
+	{
+		for (size_t y = 0; y < static_cast<size_t>(tile.h); ++y)
+		{
+			std::fill_n(dest[tile.y + y] + tile.x, tile.w, Color(0, 0));
+		}
+
+		// 圧縮された画素配列は、タイルと重なる範囲を1行ずつ展開してから合成する
+		Array<Color> row{};
+		for (size_t i = 0; i < object.layers.size(); ++i)
+		{
+			const auto& layer = object.layers[i];
+			if (opacities[i] == 0 || layer.isFolder) continue;
+
+			const Rect layerRect{layer.region.tl(), layer.imageSize()};
+			const Point tl = Math::Max(tile.tl(), layerRect.tl());
+			const Point br = Math::Min(tile.br(), layerRect.br());
+			if (br.x <= tl.x || br.y <= tl.y) continue;
+
+			const bool isCompressed = layer.image.isEmpty();
+			if (isCompressed) row.resize(br.x - tl.x);
+			for (int32 y = tl.y; y < br.y; ++y)
+			{
+				const Color* src;
+				if (isCompressed)
+				{
+					layer.compressedImage.decodeRow(y - layerRect.y, tl.x - layerRect.x, br.x - layerRect.x, row.data());
+					src = row.data();
+				}
+				else
+				{
+					src = layer.image[y - layerRect.y] + (tl.x - layerRect.x);
+				}
+				Kernel::BlendRow(dest[y] + tl.x, src, br.x - tl.x, layer.blendMode, opacities[i]);
+			}
+		}
+	}
+}
+
+namespace SivPSD
+{
+	PSDCompositor::PSDCompositor() : PSDCompositor(Config())
+	{
+	}
+
+	PSDCompositor::PSDCompositor(const Config& config) :
+		m_config(config)
+	{
+	}
+
+	Image PSDCompositor::composite(const PSDObject& object) const
+	{
+		Image image(object.documentSize, Color(0, 0));
+		compositeRegion(object, Rect(object.documentSize), image);
+		return image;
+	}
+
+	void PSDCompositor::compositeRegion(const PSDObject& object, const Rect& region, Image& dest) const
+	{
+		const Point regionTl = Math::Max(region.tl(), Point{});
+		const Point regionBr = Math::Min(region.br(), object.documentSize);
+		if (regionBr.x <= regionTl.x || regionBr.y <= regionTl.y) return;
+
+		// タイルに分割
+		const int32 tileSize = this->tileSize();
+		Array<Rect> tiles{};
+		for (int32 y = regionTl.y; y < regionBr.y; y += tileSize)
+		{
+			for (int32 x = regionTl.x; x < regionBr.x; x += tileSize)
+			{
+				tiles.emplace_back(x, y, Min(tileSize, regionBr.x - x), Min(tileSize, regionBr.y - y));
+			}
+		}
+
+		compositeTiles(object, tiles, dest);
+	}
+
+	void PSDCompositor::compositeTiles(const PSDObject& object, const Array<Rect>& tiles, Image& dest) const
+	{
+		const Array<uint8> opacities = GetEffectiveOpacities(object);
+
+		// タイルは互いに独立しているため、呼び出し元とワーカーで取り出して合成
+		const auto pool = m_config.workerPool ? m_config.workerPool : PSDWorkerPool::Global();
+		pool->workers().parallelFor(tiles.size(), m_config.maxThreads, [&](size_t index)
+		{
+			compositeTile(object, opacities, tiles[index], dest);
+		});
+	}
+
+	int32 PSDCompositor::tileSize() const noexcept
+	{
+		return Max(m_config.tileSize, 1);
+	}
+
+	Array<uint8> PSDCompositor::GetEffectiveOpacities(const PSDObject& object)
+	{
+		// 親の ID はレイヤー配列内を指すため、メモ化しながら親をたどる
+		Array<Optional<uint8>> memo(object.layers.size());
+		const std::function<uint8(size_t)> getOpacity = [&](size_t index) -> uint8
+		{
+			if (memo[index]) return *memo[index];
+
+			const auto& layer = object.layers[index];
+			uint32 opacity = layer.isVisible ? layer.opacity : 0;
+			if (opacity != 0 && layer.parentId && *layer.parentId != static_cast<PSDLayer::id_type>(index))
+			{
+				// フォルダの不透明度は子に乗算する
+				opacity = opacity * getOpacity(*layer.parentId) / 255;
+			}
+			memo[index] = static_cast<uint8>(opacity);
+			return *memo[index];
+		};
+
+		Array<uint8> opacities(object.layers.size());
+		for (size_t i = 0; i < object.layers.size(); ++i)
+		{
+			opacities[i] = object.isHiddenByClipping(object.layers[i]) ? 0 : getOpacity(i);
+		}
+		return opacities;
+	}
+}
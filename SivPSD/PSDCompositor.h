@@ -0,0 +1,49 @@
+﻿#pragma once
+#include "PSDObject.h"
+#include "PSDWorkerPool.h"
+
+namespace SivPSD
+{
+	/// @brief 表示されているレイヤーを下から順に CPU で合成し、1枚の画像にします
+	/// @remark 画素配列 (PSDLayer::image または PSDLayer::compressedImage) を持たないレイヤーは無視されるため、StoreTarget::Image などで読み込んでください
+	/// @remark フォルダは独立したバッファに合成せず、不透明度を子に乗算して子を直接重ねます。そのため子同士が重なる部分は半透明のフォルダと結果が異なり、フォルダの合成モードは無視されます (すべて通過として扱います)
+	class PSDCompositor
+	{
+	public:
+		struct Config
+		{
+			/// @brief 最大スレッド数 (呼び出し元のスレッドを含む)
+			int maxThreads = 4;
+
+			/// @brief 合成を分担するワーカー (nullptr の場合は PSDWorkerPool::Global())
+			std::shared_ptr<PSDWorkerPool> workerPool{};
+
+			/// @brief 並列処理の単位となるタイルの一辺
+			int32 tileSize = 256;
+		};
+
+		PSDCompositor();
+		explicit PSDCompositor(const Config& config);
+
+		/// @brief すべての表示レイヤーを合成した、ドキュメントサイズの画像
+		[[nodiscard]]
+		Image composite(const PSDObject& object) const;
+
+		/// @brief region 内のみを合成し、dest の同じ位置に書き込みます (dest はドキュメントサイズである必要があります)
+		void compositeRegion(const PSDObject& object, const Rect& region, Image& dest) const;
+
+		/// @brief 互いに重ならない tiles をそれぞれ並列に合成し、dest の同じ位置に書き込みます (dest はドキュメントサイズである必要があります)
+		void compositeTiles(const PSDObject& object, const Array<Rect>& tiles, Image& dest) const;
+
+		/// @brief 並列処理の単位となるタイルの一辺
+		[[nodiscard]]
+		int32 tileSize() const noexcept;
+
+		/// @brief フォルダの表示フラグと不透明度を考慮した、各レイヤーの実効不透明度 (非表示の場合は 0)
+		[[nodiscard]]
+		static Array<uint8> GetEffectiveOpacities(const PSDObject& object);
+
+	private:
+		Config m_config{};
+	};
+}
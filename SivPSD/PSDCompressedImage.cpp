@@ -0,0 +1,199 @@
+﻿#include "stdafx.h"
+#include "PSDCompressedImage.h"
+
+namespace
+{
+	using namespace SivPSD;
+
+	// 各行はパケットの並びで、パケットは LEB128 の見出し ((画素数 - 1) << 1 | 繰り返しか) に続いて、
+	// 繰り返しの場合は1画素、そうでなければ画素数分の画素をそのまま置く
+
+	void writeHeader(uint64 count, bool isRun, Array<uint8>& dest)
+	{
+		uint64 header = ((count - 1) << 1) | (isRun ? 1u : 0u);
+		while (header >= 0x80)
+		{
+			dest.push_back(static_cast<uint8>(header | 0x80));
+			header >>= 7;
+		}
+		dest.push_back(static_cast<uint8>(header));
+	}
+
+	void writePixels(const Color* src, size_t count, Array<uint8>& dest)
+	{
+		const auto bytes = reinterpret_cast<const uint8*>(src);
+		dest.insert(dest.end(), bytes, bytes + count * sizeof(Color));
+	}
+
+	void encodeRow(const Color* src, int32 width, Array<uint8>& dest)
+	{
+		int32 literalBegin = 0;
+		int32 x = 0;
+		while (x < width)
+		{
+			int32 run = 1;
+			while (x + run < width && src[x + run] == src[x]) ++run;
+
+			// 2 画素以上の繰り返しは、そのまま置くより短くなる
+			if (run < 2)
+			{
+				++x;
+				continue;
+			}
+			if (literalBegin < x)
+			{
+				writeHeader(x - literalBegin, false, dest);
+				writePixels(src + literalBegin, x - literalBegin, dest);
+			}
+			writeHeader(run, true, dest);
+			writePixels(src + x, 1, dest);
+			x += run;
+			literalBegin = x;
+		}
+		if (literalBegin < width)
+		{
+			writeHeader(width - literalBegin, false, dest);
+			writePixels(src + literalBegin, width - literalBegin, dest);
+		}
+	}
+
+	const uint8* readHeader(const uint8* src, int32& count, bool& isRun)
+	{
+		uint64 header = 0;
+		for (int shift = 0; ; shift += 7)
+		{
+			const uint8 b = *src++;
+			header |= static_cast<uint64>(b & 0x7F) << shift;
+			if ((b & 0x80) == 0) break;
+		}
+		count = static_cast<int32>(header >> 1) + 1;
+		isRun = (header & 1) != 0;
+		return src;
+	}
+}
+
+namespace SivPSD
+{
+	CompressedImage::CompressedImage(const Image& image) :
+		m_size(image.size())
+	{
+		m_rowOffsets.reserve(m_size.y + 1);
+		for (int32 y = 0; y < m_size.y; ++y)
+		{
+			m_rowOffsets.push_back(m_data.size());
+			encodeRow(image[y], m_size.x, m_data);
+		}
+		m_rowOffsets.push_back(m_data.size());
+		m_data.shrink_to_fit();
+	}
+
+	bool CompressedImage::isEmpty() const noexcept
+	{
+		return m_size.x <= 0 || m_size.y <= 0;
+	}
+
+	int32 CompressedImage::width() const noexcept
+	{
+		return m_size.x;
+	}
+
+	int32 CompressedImage::height() const noexcept
+	{
+		return m_size.y;
+	}
+
+	Size CompressedImage::size() const noexcept
+	{
+		return m_size;
+	}
+
+	size_t CompressedImage::size_bytes() const noexcept
+	{
+		return m_data.size() + m_rowOffsets.size() * sizeof(uint64);
+	}
+
+	Image CompressedImage::decode() const
+	{
+		Image image{};
+		decodeTo(image);
+		return image;
+	}
+
+	void CompressedImage::decodeTo(Image& dest) const
+	{
+		if (dest.size() != m_size) dest = Image(m_size);
+		for (int32 y = 0; y < m_size.y; ++y) decodeRow(y, dest[y]);
+	}
+
+	void CompressedImage::decodeRow(int32 y, Color* dest) const
+	{
+		decodeRow(y, 0, m_size.x, dest);
+	}
+
+	void CompressedImage::decodeRow(int32 y, int32 xBegin, int32 xEnd, Color* dest) const
+	{
+		const uint8* src = m_data.data() + m_rowOffsets[y];
+		int32 x = 0;
+		while (x < xEnd)
+		{
+			int32 count;
+			bool isRun;
+			src = readHeader(src, count, isRun);
+
+			// 範囲より前のパケットは読み飛ばす
+			const int32 from = Max(x, xBegin);
+			const int32 to = Min(x + count, xEnd);
+			if (from < to)
+			{
+				if (isRun)
+				{
+					Color color;
+					std::memcpy(&color, src, sizeof(Color));
+					std::fill_n(dest + (from - xBegin), to - from, color);
+				}
+				else
+				{
+					std::memcpy(dest + (from - xBegin), src + (from - x) * sizeof(Color), (to - from) * sizeof(Color));
+				}
+			}
+			src += (isRun ? 1 : count) * sizeof(Color);
+			x += count;
+		}
+	}
+
+	CompressedImage::RowReader CompressedImage::rows() const
+	{
+		return RowReader{*this};
+	}
+
+	CompressedImage::RowReader::RowReader(const CompressedImage& image) :
+		m_image(&image),
+		m_row(image.width())
+	{
+		if (not isEnd()) m_image->decodeRow(0, m_row.data());
+	}
+
+	int32 CompressedImage::RowReader::y() const noexcept
+	{
+		return m_y;
+	}
+
+	std::span<const Color> CompressedImage::RowReader::row() const noexcept
+	{
+		if (isEnd()) return {};
+		return std::span<const Color>{m_row.data(), m_row.size()};
+	}
+
+	bool CompressedImage::RowReader::next()
+	{
+		if (isEnd()) return false;
+		if (++m_y >= m_image->height()) return false;
+		m_image->decodeRow(m_y, m_row.data());
+		return true;
+	}
+
+	bool CompressedImage::RowReader::isEnd() const noexcept
+	{
+		return m_y >= m_image->height();
+	}
+}
@@ -0,0 +1,137 @@
+﻿#pragma once
+
+namespace SivPSD
+{
+	/// @brief 行ごとにランレングス圧縮して保持する画素配列 (必要なときに Image や行単位に展開します)
+	class CompressedImage
+	{
+	public:
+		/// @brief 先頭の行から1行ずつ展開しながら読み進めます (範囲 for 文で使えます)
+		class RowReader
+		{
+		public:
+			struct Sentinel
+			{
+			};
+
+			class Iterator
+			{
+			public:
+				using value_type = std::span<const Color>;
+				using difference_type = std::ptrdiff_t;
+
+				explicit Iterator(RowReader* reader) noexcept : m_reader(reader)
+				{
+				}
+
+				[[nodiscard]]
+				std::span<const Color> operator*() const noexcept
+				{
+					return m_reader->row();
+				}
+
+				Iterator& operator++()
+				{
+					(void)m_reader->next();
+					return *this;
+				}
+
+				void operator++(int)
+				{
+					(void)m_reader->next();
+				}
+
+				[[nodiscard]]
+				bool operator==(Sentinel) const noexcept
+				{
+					return m_reader->isEnd();
+				}
+
+			private:
+				RowReader* m_reader;
+			};
+
+			explicit RowReader(const CompressedImage& image);
+
+			/// @brief 現在の行番号
+			[[nodiscard]]
+			int32 y() const noexcept;
+
+			/// @brief 現在の行の画素 (最後の行の後は空)
+			[[nodiscard]]
+			std::span<const Color> row() const noexcept;
+
+			/// @brief 次の行を展開します
+			/// @return 最後の行の後に進んだ場合 false
+			bool next();
+
+			[[nodiscard]]
+			bool isEnd() const noexcept;
+
+			[[nodiscard]]
+			Iterator begin() noexcept
+			{
+				return Iterator{this};
+			}
+
+			[[nodiscard]]
+			Sentinel end() const noexcept
+			{
+				return {};
+			}
+
+		private:
+			const CompressedImage* m_image;
+
+			int32 m_y{};
+
+			/// @brief 展開した行 (行をまたいで使い回す)
+			Array<Color> m_row{};
+		};
+
+		CompressedImage() = default;
+
+		explicit CompressedImage(const Image& image);
+
+		[[nodiscard]]
+		bool isEmpty() const noexcept;
+
+		[[nodiscard]]
+		int32 width() const noexcept;
+
+		[[nodiscard]]
+		int32 height() const noexcept;
+
+		[[nodiscard]]
+		Size size() const noexcept;
+
+		/// @brief 圧縮後のバイト数 (行の位置の表を含みます)
+		[[nodiscard]]
+		size_t size_bytes() const noexcept;
+
+		/// @brief 展開した画像
+		[[nodiscard]]
+		Image decode() const;
+
+		/// @brief dest に展開します (dest の大きさが同じ場合は画素配列を確保し直さずに使い回します)
+		void decodeTo(Image& dest) const;
+
+		/// @brief y 行目を dest に展開します (dest には width() 個の画素が必要です)
+		void decodeRow(int32 y, Color* dest) const;
+
+		/// @brief y 行目の [xBegin, xEnd) の範囲を dest に展開します
+		void decodeRow(int32 y, int32 xBegin, int32 xEnd, Color* dest) const;
+
+		/// @brief 画像全体を展開せずに、1行ずつ展開しながら読み進めます
+		[[nodiscard]]
+		RowReader rows() const;
+
+	private:
+		Size m_size{};
+
+		/// @brief 各行の m_data 内の先頭位置 (末尾に全体のバイト数を含む)
+		Array<uint64> m_rowOffsets{};
+
+		Array<uint8> m_data{};
+	};
+}
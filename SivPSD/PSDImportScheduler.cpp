@@ -0,0 +1,185 @@
+﻿#include "stdafx.h"
+#include "PSDImportScheduler.h"
+
+namespace
+{
+	using namespace SivPSD;
+
+	/// @brief 呼び出したスレッドが属するプールとワーカー番号
+	thread_local const WorkerPool* t_currentPool{};
+	thread_local size_t t_currentWorker{};
+}
+
+namespace SivPSD
+{
+	WorkerPool::WorkerPool(int32 threadCount)
+	{
+		if (threadCount <= 0) threadCount = Max(1, static_cast<int32>(std::thread::hardware_concurrency()));
+
+		for (int32 i = 0; i < threadCount; ++i) m_workers.push_back(std::make_unique<Worker>());
+		for (int32 i = 0; i < threadCount; ++i) m_threads.emplace_back([this, i]() { run(i); });
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard lock{m_sleepMutex};
+			m_stopping = true;
+		}
+		m_wake.notify_all();
+		for (auto& thread : m_threads) thread.join();
+	}
+
+	void WorkerPool::submit(std::function<void()> task)
+	{
+		const size_t index = t_currentPool == this
+			                     ? t_currentWorker
+			                     : m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+		{
+			std::lock_guard lock{m_workers[index]->mutex};
+			m_workers[index]->tasks.push_back(std::move(task));
+		}
+		{
+			std::lock_guard lock{m_sleepMutex};
+			m_pending.fetch_add(1);
+		}
+		m_wake.notify_one();
+	}
+
+	void WorkerPool::parallelFor(size_t count, int32 maxTasks, const std::function<void(size_t)>& body)
+	{
+		if (count == 0) return;
+
+		struct State
+		{
+			const std::function<void(size_t)>* body{};
+			size_t count{};
+			std::atomic<size_t> next{};
+			std::mutex mutex{};
+			std::condition_variable finished{};
+			size_t completed{};
+		};
+		const auto state = std::make_shared<State>();
+		state->body = &body;
+		state->count = count;
+
+		// 取り出せた番号のみ処理するため、開始が遅れたタスクは body に触れずに終わる
+		const auto work = [](State& s)
+		{
+			size_t processed = 0;
+			for (size_t i = s.next++; i < s.count; i = s.next++, ++processed) (*s.body)(i);
+			if (processed == 0) return;
+
+			std::lock_guard lock{s.mutex};
+			s.completed += processed;
+			if (s.completed == s.count) s.finished.notify_all();
+		};
+
+		const size_t helperCount = std::min({static_cast<size_t>(Max(maxTasks, 1)) - 1, m_workers.size(), count - 1});
+		for (size_t i = 0; i < helperCount; ++i) submit([state, work]() { work(*state); });
+		work(*state);
+
+		// 他のスレッドが処理中の番号のみを待つ
+		std::unique_lock lock{state->mutex};
+		state->finished.wait(lock, [&]() { return state->completed == state->count; });
+	}
+
+	int32 WorkerPool::threadCount() const noexcept
+	{
+		return static_cast<int32>(m_workers.size());
+	}
+
+	void WorkerPool::run(size_t index)
+	{
+		t_currentPool = this;
+		t_currentWorker = index;
+
+		std::function<void()> task{};
+		while (true)
+		{
+			if (popTask(index, task))
+			{
+				m_pending.fetch_sub(1);
+				task();
+				task = nullptr;
+				continue;
+			}
+
+			std::unique_lock lock{m_sleepMutex};
+			m_wake.wait(lock, [&]() { return m_pending.load() > 0 || m_stopping; });
+			if (m_stopping && m_pending.load() == 0) return;
+		}
+	}
+
+	bool WorkerPool::popTask(size_t index, std::function<void()>& task)
+	{
+		{
+			auto& own = *m_workers[index];
+			std::lock_guard lock{own.mutex};
+			if (not own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < m_workers.size(); ++i)
+		{
+			auto& victim = *m_workers[(index + i) % m_workers.size()];
+			std::lock_guard lock{victim.mutex};
+			if (not victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	MemoryBudget::MemoryBudget(size_t capacity) : m_capacity(capacity)
+	{
+	}
+
+	void MemoryBudget::acquire(size_t bytes, std::function<void()> continuation)
+	{
+		{
+			std::lock_guard lock{m_mutex};
+			const bool fits = m_capacity == 0 || m_used == 0 || m_used + bytes <= m_capacity;
+			if (not m_waiting.empty() || not fits)
+			{
+				m_waiting.emplace_back(bytes, std::move(continuation));
+				return;
+			}
+			m_used += bytes;
+		}
+		continuation();
+	}
+
+	void MemoryBudget::release(size_t bytes)
+	{
+		Array<std::function<void()>> admitted{};
+		{
+			std::lock_guard lock{m_mutex};
+			m_used -= Min(bytes, m_used);
+
+			// 要求した順に、収まるものを続けて確保する
+			while (not m_waiting.empty())
+			{
+				const size_t waitingBytes = m_waiting.front().first;
+				if (m_capacity != 0 && m_used != 0 && m_used + waitingBytes > m_capacity) break;
+				m_used += waitingBytes;
+				admitted.push_back(std::move(m_waiting.front().second));
+				m_waiting.pop_front();
+			}
+		}
+		for (auto& continuation : admitted) continuation();
+	}
+
+	size_t MemoryBudget::usedBytes() const
+	{
+		std::lock_guard lock{m_mutex};
+		return m_used;
+	}
+}
@@ -0,0 +1,103 @@
+﻿#pragma once
+#include "PSDImportStats.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace SivPSD
+{
+	/// @brief ワーカーごとにタスクの両端キューを持ち、空いたワーカーが他のワーカーのタスクを盗むスレッドプール
+	class WorkerPool
+	{
+	public:
+		/// @param threadCount ワーカー数 (0 以下の場合は論理コア数)
+		explicit WorkerPool(int32 threadCount);
+
+		/// @brief 投入済みのタスクをすべて処理してから終了します
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool&) = delete;
+
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		/// @brief タスクを投入します (ワーカーから呼んだ場合はそのワーカーのキューに積まれ、先に処理されます)
+		void submit(std::function<void()> task);
+
+		/// @brief body(0), ..., body(count - 1) を呼び出し元と最大 maxTasks - 1 個のワーカーで分担し、すべて終わるまで待ちます
+		/// @remark 呼び出し元も処理に加わり、開始していないワーカー側のタスクは待たないため、ワーカーから呼んでもワーカーを塞ぎません
+		void parallelFor(size_t count, int32 maxTasks, const std::function<void(size_t)>& body);
+
+		[[nodiscard]]
+		int32 threadCount() const noexcept;
+
+	private:
+		struct Worker
+		{
+			std::mutex mutex{};
+			std::deque<std::function<void()>> tasks{};
+		};
+
+		void run(size_t index);
+
+		/// @brief 自分のキューの末尾から取り出し、空なら他のワーカーのキューの先頭から盗む
+		bool popTask(size_t index, std::function<void()>& task);
+
+		Array<std::unique_ptr<Worker>> m_workers{};
+		Array<std::thread> m_threads{};
+
+		std::mutex m_sleepMutex{};
+		std::condition_variable m_wake{};
+		std::atomic<size_t> m_pending{};
+		std::atomic<size_t> m_nextWorker{};
+		bool m_stopping{};
+	};
+
+	/// @brief 複数の読み込みで共有するメモリの上限 (確保できるまで続きの処理を保留する)
+	class MemoryBudget
+	{
+	public:
+		/// @param capacity 上限バイト数 (0 の場合は無制限)
+		explicit MemoryBudget(size_t capacity);
+
+		/// @brief bytes を確保できたら continuation を呼びます (確保できない場合は解放されるまで保留し、要求した順に呼びます)
+		/// @remark 他に確保されていない場合は上限を超えていても確保します
+		void acquire(size_t bytes, std::function<void()> continuation);
+
+		void release(size_t bytes);
+
+		[[nodiscard]]
+		size_t usedBytes() const;
+
+	private:
+		size_t m_capacity;
+
+		mutable std::mutex m_mutex{};
+		size_t m_used{};
+		std::deque<std::pair<size_t, std::function<void()>>> m_waiting{};
+	};
+
+	/// @brief PSDImporter を共有のワーカーで実行するための環境 (PSDBatchImporter がファイルごとに作る)
+	struct ImportScheduler
+	{
+		WorkerPool* pool{};
+
+		/// @brief nullptr の場合は無制限
+		MemoryBudget* memoryBudget{};
+
+		/// @brief true の場合、開始していない読み込みと作業単位を処理せずに終える
+		const std::atomic<bool>* cancelled{};
+
+		/// @brief 読み込みの終了時 (成功、失敗とも) にワーカーから呼ばれる
+		/// @param heldBytes memoryBudget から確保したまま、画素が保持しているバイト数
+		std::function<void(PSDObject&& object, Optional<PSDError> error, ImportStats&& stats, size_t heldBytes)>
+		onFinished{};
+
+		[[nodiscard]]
+		bool isCancelled() const noexcept
+		{
+			return cancelled && cancelled->load(std::memory_order_relaxed);
+		}
+	};
+}
@@ -0,0 +1,74 @@
+﻿#include "stdafx.h"
+#include "PSDImportStats.h"
+
+namespace SivPSD
+{
+	StringView ToString(ImportPhase phase) noexcept
+	{
+		switch (phase)
+		{
+		case ImportPhase::Open:
+			return U"Open"_sv;
+		case ImportPhase::Preview:
+			return U"Preview"_sv;
+		case ImportPhase::Decode:
+			return U"Decode"_sv;
+		case ImportPhase::Interleave:
+			return U"Interleave"_sv;
+		case ImportPhase::Texture:
+			return U"Texture"_sv;
+		case ImportPhase::Finish:
+			return U"Finish"_sv;
+		default:
+			return U"Unknown"_sv;
+		}
+	}
+
+	double ImportStats::ThreadStats::utilization() const noexcept
+	{
+		return lifetimeSec <= 0 ? 0.0 : busySec / lifetimeSec;
+	}
+
+	const ImportStats::PhaseStats& ImportStats::phase(ImportPhase p) const noexcept
+	{
+		return phases[static_cast<size_t>(p)];
+	}
+
+	bool ImportStats::exportChromeTrace(FilePathView path) const
+	{
+		Array<JSON> events{};
+
+		// スレッド名
+		for (const auto& thread : threads)
+		{
+			JSON event{};
+			event[U"name"] = U"thread_name";
+			event[U"ph"] = U"M";
+			event[U"pid"] = 1;
+			event[U"tid"] = thread.threadId;
+			event[U"args"][U"name"] = thread.threadId == 0 ? U"Importer"_s : U"Worker {}"_fmt(thread.threadId);
+			events.push_back(event);
+		}
+
+		for (const auto& trace : traceEvents)
+		{
+			JSON event{};
+			event[U"name"] = trace.layerId
+				                 ? U"{} #{}"_fmt(ToString(trace.phase), *trace.layerId)
+				                 : String{ToString(trace.phase)};
+			event[U"cat"] = ToString(trace.phase);
+			event[U"ph"] = U"X";
+			event[U"pid"] = 1;
+			event[U"tid"] = trace.threadId;
+			event[U"ts"] = trace.beginSec * 1000000.0;
+			event[U"dur"] = trace.durationSec * 1000000.0;
+			if (trace.layerId) event[U"args"][U"layer"] = *trace.layerId;
+			events.push_back(event);
+		}
+
+		JSON json{};
+		json[U"traceEvents"] = events;
+		json[U"displayTimeUnit"] = U"ms";
+		return json.saveMinimum(path);
+	}
+}
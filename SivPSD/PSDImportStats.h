@@ -0,0 +1,111 @@
+﻿#pragma once
+#include "PSDObject.h"
+
+namespace SivPSD
+{
+	/// @brief 読み込みの処理段階
+	enum class ImportPhase : uint8
+	{
+		/// @brief ファイルを開き、ドキュメントとレイヤー情報を解析
+		Open,
+		/// @brief 統合画像のプレビューの展開
+		Preview,
+		/// @brief チャンネルデータの読み込みと展開 (RLE の解凍)
+		Decode,
+		/// @brief チャンネルを RGBA にインターリーブ (キャンバスへの配置、余白の除去、マスクの焼き込みを含む)
+		Interleave,
+		/// @brief テクスチャの作成
+		Texture,
+		/// @brief 全レイヤーの展開後の処理 (クリッピング、キャッシュファイル、アトラス)
+		Finish,
+	};
+
+	constexpr size_t ImportPhaseCount = 6;
+
+	[[nodiscard]]
+	StringView ToString(ImportPhase phase) noexcept;
+
+	/// @brief 読み込みの計測結果 (PSDImporter::Config::collectStats が true の場合のみ)
+	struct ImportStats
+	{
+		struct PhaseStats
+		{
+			/// @brief 最初に始まってから最後に終わるまでの時間
+			double wallSec{};
+
+			/// @brief 各スレッドがこの段階に費やした時間の合計
+			double threadSec{};
+
+			/// @brief 各スレッドがこの段階に費やした CPU 時間の合計
+			double cpuSec{};
+		};
+
+		struct ThreadStats
+		{
+			/// @brief 0 は読み込みを開始したスレッド、1 以降はワーカー
+			int32 threadId{};
+
+			/// @brief スレッドが開始してから終了するまでの時間
+			double lifetimeSec{};
+
+			/// @brief 作業単位を処理していた時間
+			double busySec{};
+
+			/// @brief 1回の作業単位で確保した作業用メモリの最大バイト数
+			size_t peakScratchBytes{};
+
+			/// @brief busySec / lifetimeSec
+			[[nodiscard]]
+			double utilization() const noexcept;
+		};
+
+		struct LayerStats
+		{
+			PSDLayer::id_type id{};
+			String name{};
+
+			/// @brief 各スレッドがこのレイヤーの処理に費やした時間の合計
+			double sec{};
+
+			/// @brief ファイル内の圧縮されたチャンネルデータのバイト数
+			uint64 compressedBytes{};
+		};
+
+		/// @brief スレッドの時系列 (collectTrace が true の場合のみ)
+		struct TraceEvent
+		{
+			ImportPhase phase{};
+			int32 threadId{};
+
+			/// @brief 読み込み開始からの時刻
+			double beginSec{};
+
+			double durationSec{};
+			Optional<PSDLayer::id_type> layerId{};
+		};
+
+		/// @brief 読み込み開始から完了までの時間
+		double totalSec{};
+
+		std::array<PhaseStats, ImportPhaseCount> phases{};
+
+		/// @brief ファイルから読み込んだチャンネルデータのバイト数
+		uint64 bytesRead{};
+
+		/// @brief 展開後のチャンネルデータのバイト数
+		uint64 bytesDecompressed{};
+
+		Array<ThreadStats> threads{};
+
+		/// @brief 処理に時間のかかったレイヤー (遅い順に PSDImporter::Config::statsSlowestLayers 個まで)
+		Array<LayerStats> slowestLayers{};
+
+		Array<TraceEvent> traceEvents{};
+
+		[[nodiscard]]
+		const PhaseStats& phase(ImportPhase p) const noexcept;
+
+		/// @brief chrome://tracing や Perfetto で開ける JSON を書き出します (collectTrace が true の場合のみイベントを含みます)
+		bool exportChromeTrace(FilePathView path) const;
+	};
+}
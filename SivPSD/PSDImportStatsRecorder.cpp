@@ -0,0 +1,167 @@
+﻿#include "stdafx.h"
+#include "PSDImportStatsRecorder.h"
+
+#if SIV3D_PLATFORM(WINDOWS)
+#include <Siv3D/Windows/Windows.hpp>
+#else
+#include <time.h>
+#endif
+
+namespace
+{
+	/// @brief 呼び出したスレッドの CPU 時間
+	double getThreadCpuSec()
+	{
+#if SIV3D_PLATFORM(WINDOWS)
+		FILETIME creation, exit, kernel, user;
+		if (not ::GetThreadTimes(::GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0.0;
+
+		// 100 ナノ秒単位
+		const auto toTicks = [](const FILETIME& t)
+		{
+			return (static_cast<uint64>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+		};
+		return (toTicks(kernel) + toTicks(user)) * 1e-7;
+#else
+		timespec t{};
+		if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) != 0) return 0.0;
+		return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+	}
+}
+
+namespace SivPSD
+{
+	ImportStatsRecorder::ImportStatsRecorder(bool collectTrace) : m_collectTrace(collectTrace)
+	{
+	}
+
+	double ImportStatsRecorder::now() const
+	{
+		return m_clock.sF();
+	}
+
+	bool ImportStatsRecorder::collectsTrace() const noexcept
+	{
+		return m_collectTrace;
+	}
+
+	ImportStatsRecorder::ThreadRecord& ImportStatsRecorder::beginThread()
+	{
+		std::lock_guard lock{m_mutex};
+		auto& record = m_threads.emplace_back(std::make_unique<ThreadRecord>());
+		record->recorder = this;
+		record->threadId = static_cast<int32>(m_threads.size() - 1);
+		record->beginSec = now();
+		return *record;
+	}
+
+	void ImportStatsRecorder::endThread(ThreadRecord& record) const
+	{
+		record.endSec = now();
+	}
+
+	void ImportStatsRecorder::setCompressedBytes(Array<uint64> compressedBytes)
+	{
+		m_compressedBytes = std::move(compressedBytes);
+	}
+
+	ImportStats ImportStatsRecorder::build(const PSDObject& object, int32 slowestCount) const
+	{
+		std::lock_guard lock{m_mutex};
+
+		ImportStats stats{};
+		stats.totalSec = now();
+
+		std::array<double, ImportPhaseCount> firstBegin{};
+		std::array<double, ImportPhaseCount> lastEnd{};
+		firstBegin.fill(std::numeric_limits<double>::infinity());
+
+		Array<double> layerSec(object.layers.size());
+		for (const auto& thread : m_threads)
+		{
+			const double endSec = thread->endSec > 0 ? thread->endSec : stats.totalSec;
+			stats.threads.push_back({
+				.threadId = thread->threadId,
+				.lifetimeSec = endSec - thread->beginSec,
+				.peakScratchBytes = thread->peakScratchBytes,
+			});
+			stats.bytesRead += thread->bytesRead;
+			stats.bytesDecompressed += thread->bytesDecompressed;
+
+			// 段階の計測は入れ子にしないため、その合計を作業していた時間とみなす
+			for (size_t p = 0; p < ImportPhaseCount; ++p)
+			{
+				const auto& phase = thread->phases[p];
+				stats.threads.back().busySec += phase.threadSec;
+				firstBegin[p] = Min(firstBegin[p], phase.firstBeginSec);
+				lastEnd[p] = Max(lastEnd[p], phase.lastEndSec);
+				stats.phases[p].threadSec += phase.threadSec;
+				stats.phases[p].cpuSec += phase.cpuSec;
+			}
+
+			for (const auto& [index, sec] : thread->layerTimes)
+			{
+				if (index < static_cast<int32>(layerSec.size())) layerSec[index] += sec;
+			}
+
+			stats.traceEvents.append(thread->events);
+		}
+
+		for (size_t p = 0; p < ImportPhaseCount; ++p)
+		{
+			if (lastEnd[p] > firstBegin[p]) stats.phases[p].wallSec = lastEnd[p] - firstBegin[p];
+		}
+
+		// 時間のかかったレイヤー
+		Array<size_t> order = Iota(layerSec.size()).asArray();
+		order.remove_if([&](size_t i) { return layerSec[i] <= 0; });
+		order.stable_sort_by([&](size_t a, size_t b) { return layerSec[a] > layerSec[b]; });
+		order.resize(Min(order.size(), static_cast<size_t>(Max(slowestCount, 0))));
+		for (const size_t i : order)
+		{
+			stats.slowestLayers.push_back({
+				.id = object.layers[i].id,
+				.name = object.layers[i].name,
+				.sec = layerSec[i],
+				.compressedBytes = i < m_compressedBytes.size() ? m_compressedBytes[i] : 0,
+			});
+		}
+
+		for (auto& event : stats.traceEvents)
+		{
+			if (event.layerId && *event.layerId < static_cast<int32>(object.layers.size()))
+			{
+				event.layerId = object.layers[*event.layerId].id;
+			}
+		}
+		stats.traceEvents.sort_by([](const auto& a, const auto& b) { return a.beginSec < b.beginSec; });
+		return stats;
+	}
+
+	PhaseTimer::PhaseTimer(ImportStatsRecorder::ThreadRecord* record, ImportPhase phase, Optional<int32> layerIndex) :
+		m_record(record), m_phase(phase), m_layerIndex(layerIndex)
+	{
+		if (not m_record) return;
+		m_beginSec = m_record->recorder->now();
+		m_beginCpuSec = getThreadCpuSec();
+	}
+
+	PhaseTimer::~PhaseTimer()
+	{
+		if (not m_record) return;
+
+		const double endSec = m_record->recorder->now();
+		auto& phase = m_record->phases[static_cast<size_t>(m_phase)];
+		phase.firstBeginSec = Min(phase.firstBeginSec, m_beginSec);
+		phase.lastEndSec = Max(phase.lastEndSec, endSec);
+		phase.threadSec += endSec - m_beginSec;
+		phase.cpuSec += getThreadCpuSec() - m_beginCpuSec;
+
+		if (m_layerIndex) m_record->layerTimes.emplace_back(*m_layerIndex, endSec - m_beginSec);
+		if (m_record->recorder->collectsTrace())
+		{
+			m_record->events.push_back({m_phase, m_record->threadId, m_beginSec, endSec - m_beginSec, m_layerIndex});
+		}
+	}
+}
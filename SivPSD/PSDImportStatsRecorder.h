@@ -0,0 +1,94 @@
+﻿#pragma once
+#include "PSDImportStats.h"
+
+#include <mutex>
+
+namespace SivPSD
+{
+	/// @brief 読み込み中の計測を記録する (計測しない場合は作られず、計測箇所は nullptr の確認のみになります)
+	class ImportStatsRecorder
+	{
+	public:
+		/// @brief スレッドごとの記録 (各スレッドは自分の記録にのみ書き込むため、ロックは不要)
+		struct ThreadRecord
+		{
+			struct PhaseRecord
+			{
+				double firstBeginSec = std::numeric_limits<double>::infinity();
+				double lastEndSec{};
+				double threadSec{};
+				double cpuSec{};
+			};
+
+			ImportStatsRecorder* recorder{};
+			int32 threadId{};
+			double beginSec{};
+			double endSec{};
+			size_t peakScratchBytes{};
+			uint64 bytesRead{};
+			uint64 bytesDecompressed{};
+			std::array<PhaseRecord, ImportPhaseCount> phases{};
+
+			/// @brief レイヤー番号とそのレイヤーに費やした時間
+			Array<std::pair<int32, double>> layerTimes{};
+
+			/// @brief layerId にはレイヤー番号を入れ、build() で ID に置き換える
+			Array<ImportStats::TraceEvent> events{};
+
+			void addScratch(size_t bytes) noexcept
+			{
+				peakScratchBytes = Max(peakScratchBytes, bytes);
+			}
+		};
+
+		explicit ImportStatsRecorder(bool collectTrace);
+
+		/// @brief 計測開始からの時刻
+		[[nodiscard]]
+		double now() const;
+
+		[[nodiscard]]
+		bool collectsTrace() const noexcept;
+
+		/// @brief 呼び出したスレッドの記録を作る
+		ThreadRecord& beginThread();
+
+		void endThread(ThreadRecord& record) const;
+
+		/// @brief レイヤーごとの圧縮されたチャンネルデータのバイト数 (時間のかかったレイヤーの表示用)
+		void setCompressedBytes(Array<uint64> compressedBytes);
+
+		/// @param slowestCount 時間のかかったレイヤーを残す数
+		[[nodiscard]]
+		ImportStats build(const PSDObject& object, int32 slowestCount) const;
+
+	private:
+		Stopwatch m_clock{StartImmediately::Yes};
+		bool m_collectTrace{};
+
+		Array<uint64> m_compressedBytes{};
+
+		mutable std::mutex m_mutex{};
+		Array<std::unique_ptr<ThreadRecord>> m_threads{};
+	};
+
+	/// @brief スコープの間を段階の時間として記録する (record が nullptr の場合は何もしない)
+	class PhaseTimer
+	{
+	public:
+		PhaseTimer(ImportStatsRecorder::ThreadRecord* record, ImportPhase phase, Optional<int32> layerIndex = none);
+
+		~PhaseTimer();
+
+		PhaseTimer(const PhaseTimer&) = delete;
+
+		PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+	private:
+		ImportStatsRecorder::ThreadRecord* m_record;
+		ImportPhase m_phase;
+		Optional<int32> m_layerIndex;
+		double m_beginSec{};
+		double m_beginCpuSec{};
+	};
+}
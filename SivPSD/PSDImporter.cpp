@@ -1,10 +1,20 @@
 ﻿#include "stdafx.h"
 #include "PSDImporter.h"
+#include "PSDArenaAllocator.h"
+#include "PSDAtlasPacker.h"
+#include "PSDCacheFile.h"
+#include "PSDChannelDecoder.h"
+#include "PSDImportScheduler.h"
+#include "PSDImportStatsRecorder.h"
+#include "PSDKernel.h"
+#include "PSDMappedFile.h"
+#include "PSDWorkerPool.h"
+
+#include <list>
+#include <span>
 
 #include "Psd/Psd.h"
 #include "Psd/PsdPlatform.h"
-#include "Psd/PsdMallocAllocator.h"
-#include "Psd/PsdNativeFile.h"
 #include "Psd/PsdDocument.h"
 #include "Psd/PsdColorMode.h"
 #include "Psd/PsdLayer.h"
@@ -15,8 +25,6 @@
 #include "Psd/PsdLayerMaskSection.h"
 #include "Psd/PsdParseDocument.h"
 #include "Psd/PsdParseLayerMaskSection.h"
-#include "Psd/PsdLayerCanvasCopy.h"
-#include "Psd/PsdInterleave.h"
 #include "Psd/PsdExportDocument.h"
 #include "Psd/PsdLayerType.h"
 
@@ -27,28 +35,112 @@ namespace
 
 	constexpr uint32 invalidChannelValue = UINT_MAX;
 
+	/// @brief 1レイヤーが持つ色とアルファのチャンネル数の上限 (CMYK + アルファ)
+	constexpr size_t MaxLayerChannels = 5;
+
+	/// @brief 1レイヤーで展開するチャンネル数の上限 (色とアルファ + レイヤーマスク + ベクトルマスク)
+	constexpr size_t MaxLayerPlanes = MaxLayerChannels + 2;
+
+	/// @brief アルファに焼き込むマスクの種類
+	enum class MaskKind
+	{
+		Layer,
+		Vector,
+	};
+
+	/// @brief アルファに焼き込むマスク
+	struct LayerMaskChannel
+	{
+		MaskKind kind{};
+
+		/// @brief LayerChannels::indices 内の位置 (マスクの範囲が空でチャンネルデータを持たない場合は -1)
+		int plane = -1;
+	};
+
+	/// @brief レイヤーの展開するチャンネルの番号 (色チャンネル、アルファ、マスクの順に続く)
+	struct LayerChannels
+	{
+		std::array<uint32, MaxLayerPlanes> indices{};
+		int count{};
+
+		/// @brief 色とアルファのチャンネル数
+		int colorCount{};
+
+		std::array<LayerMaskChannel, 2> masks{};
+		int maskCount{};
+
+		[[nodiscard]]
+		std::span<const uint32> span() const noexcept
+		{
+			return {indices.data(), static_cast<size_t>(count)};
+		}
+	};
+
+	/// @brief チャンネルごとのデータの先頭 (使われないチャンネルは nullptr)
+	using ChannelDataArray = std::array<const uint8*, MaxLayerChannels>;
+
+	/// @brief アルファに焼き込むマスクの展開結果
+	struct MaskPlane
+	{
+		/// @brief ドキュメント座標の範囲
+		Rect rect{};
+
+		/// @brief rect の大きさのチャンネルデータ (ドキュメントのビット深度のまま。範囲が空の場合は nullptr)
+		const uint8* data{};
+
+		/// @brief rect の外側の値
+		uint8 defaultColor{};
+	};
+
+	/// @brief 画素を透明な範囲を除いて切り詰めるか (余白を残す場合は切り詰めない)
+	bool isTrimStore(const PSDImporter::Config& config)
+	{
+		return config.trimTransparent && config.marginRemove;
+	}
+
+	/// @brief PSDImporter::Config で焼き込みが有効なマスクと切り詰めの種類 (キャッシュファイルの判定に使う)
+	uint32 getBakedMaskFlags(const PSDImporter::Config& config)
+	{
+		return (config.bakeLayerMask ? 1u : 0u)
+			| (config.bakeVectorMask ? 2u : 0u)
+			| (config.bakeClipping && not config.lazyDecode ? 4u : 0u)
+			| (isTrimStore(config) ? 8u : 0u);
+	}
+
+	/// @brief カラーモードごとの色チャンネルの種類 (サポートしていないモードは空)
+	std::span<const int16> getColorChannelTypes(uint32 mode)
+	{
+		static constexpr std::array<int16, 3> rgb{channelType::R, channelType::G, channelType::B};
+		static constexpr std::array<int16, 1> grayscale{0};
+		static constexpr std::array<int16, 4> cmyk{0, 1, 2, 3};
+		static constexpr std::array<int16, 3> lab{0, 1, 2};
+		switch (mode)
+		{
+		case colorMode::RGB:
+			return rgb;
+		case colorMode::GRAYSCALE:
+			return grayscale;
+		case colorMode::CMYK:
+			return cmyk;
+		case colorMode::LAB:
+			return lab;
+		default:
+			return {};
+		}
+	}
+
 	uint32 findChannel(const Layer* layer, int16 channelType)
 	{
 		for (uint32 i = 0; i < layer->channelCount; ++i)
 		{
 			const Channel* channel = &layer->channels[i];
-			if (channel->data && channel->type == channelType)
+			if (channel->type == channelType)
 				return i;
 		}
 
 		return invalidChannelValue;
 	}
 
-	void expandChannelToCanvas(
-		const Layer* layer, const Channel* channel, Array<uint8>& canvasData, Size canvasSize)
-	{
-		imageUtil::CopyLayerData(
-			static_cast<uint8*>(channel->data),
-			canvasData.data(),
-			layer->left, layer->top, layer->right, layer->bottom,
-			canvasSize.x, canvasSize.y);
-	}
-
 	PSDError concatError(const Optional<PSDError>& currentError, StringView newError)
 	{
 		return PSDError(currentError.value_or(PSDError()).what().isEmpty()
@@ -69,6 +161,36 @@ namespace
 		return none;
 	}
 
+	/// @brief 4文字の合成モードキー
+	constexpr uint32 blendModeKey(const char (&key)[5])
+	{
+		return (static_cast<uint32>(key[0]) << 24)
+			| (static_cast<uint32>(key[1]) << 16)
+			| (static_cast<uint32>(key[2]) << 8)
+			| static_cast<uint32>(key[3]);
+	}
+
+	PSDBlendMode toBlendMode(uint32 key)
+	{
+		switch (key)
+		{
+		case blendModeKey("pass"):
+			return PSDBlendMode::PassThrough;
+		case blendModeKey("norm"):
+			return PSDBlendMode::Normal;
+		case blendModeKey("mul "):
+			return PSDBlendMode::Multiply;
+		case blendModeKey("scrn"):
+			return PSDBlendMode::Screen;
+		case blendModeKey("over"):
+			return PSDBlendMode::Overlay;
+		case blendModeKey("lddg"):
+			return PSDBlendMode::Add;
+		default:
+			return PSDBlendMode::Unsupported;
+		}
+	}
+
 	TextureDesc getTextureDesc(StoreTarget storeTarget)
 	{
 		const bool hasMipmap = storeTarget == StoreTarget::MipmapTexture
@@ -78,7 +200,34 @@ namespace
 
 	bool isTextureStore(StoreTarget storeTarget)
 	{
-		return storeTarget != StoreTarget::Image;
+		return storeTarget != StoreTarget::Image && storeTarget != StoreTarget::CompressedImage;
+	}
+
+	bool isImageStore(StoreTarget storeTarget)
+	{
+		return storeTarget != StoreTarget::Texture
+			&& storeTarget != StoreTarget::MipmapTexture
+			&& storeTarget != StoreTarget::AtlasTexture
+			&& storeTarget != StoreTarget::CompressedImage;
+	}
+
+	/// @brief 画素が同じレイヤー同士でテクスチャを共有するか (画像は値として保持されるため、画像のみの格納では共有しない)
+	bool isDedupStore(const PSDImporter::Config& config)
+	{
+		return config.deduplicateLayers && not config.lazyDecode && isTextureStore(config.storeTarget);
+	}
+
+	/// @brief 展開後にキャッシュファイルへ書き出すか
+	bool isCacheFileStore(const PSDImporter::Config& config)
+	{
+		return config.useCacheFile && not config.lazyDecode && not config.keepFloatImage;
+	}
+
+	/// @brief 全レイヤーの展開後にアトラスへ詰め込むか (遅延展開時と余白を残す場合は単体のテクスチャにする)
+	bool isAtlasStore(const PSDImporter::Config& config)
+	{
+		return (config.storeTarget == StoreTarget::AtlasTexture || config.storeTarget == StoreTarget::ImageAndAtlasTexture)
+			&& config.marginRemove && not config.lazyDecode;
 	}
 
 	Point getLayerTopLeft(const Layer& layer)
@@ -90,63 +239,141 @@ namespace
 	{
 		const auto imageTl = getLayerTopLeft(layer);
 		const auto imageBr = Math::Min(Point{layer.right, layer.bottom}, documentSize);
-		return imageBr - imageTl;
+		return Math::Max(imageBr - imageTl, Size{});
 	}
 
-	// スレッドごとに作成
-	class LayerImporter
+	bool isSupportedBitsPerChannel(uint32 bitsPerChannel)
 	{
-	public:
-		struct Props
-		{
-			PSDImporter::Config config;
-			NativeFile* file;
-			Document* document;
-			LayerMaskSection* layerMaskSection;
-			Size canvasSize;
-		};
+		return bitsPerChannel == 8 || bitsPerChannel == 16 || bitsPerChannel == 32;
+	}
 
-		LayerImporter(Props props) : props(std::move(props))
-		{
-			m_canvasData.fill(Array<uint8>(props.canvasSize.x * props.canvasSize.y));
-			m_colorArray = Array<Color>{props.document->width * props.document->height};
-		}
+	/// @brief 展開後のチャンネルデータの1画素あたりのバイト数 (16 ビットは uint16, 32 ビットは float)
+	int getBytesPerChannel(const Document* document)
+	{
+		return static_cast<int>(document->bitsPerChannel / 8);
+	}
 
-		void readLayer(int index, PSDLayer& outputLayer);
+	/// @brief チャンネルデータ内で、ドキュメントにクリップされた領域の先頭を指すポインタ
+	const uint8* getClippedChannelData(const Layer& layer, const uint8* channelData, Point imageTl, int bytesPerChannel)
+	{
+		const int channelWidth = layer.right - layer.left;
+		const auto offset = imageTl - Point{layer.left, layer.top};
+		return channelData + (static_cast<size_t>(offset.y) * channelWidth + offset.x) * bytesPerChannel;
+	}
 
-	private:
-		Image storeImageWithoutMargin(const Array<Color>& colorArray, Point imageTl, Size imageSize) const
+	/// @brief レイヤー矩形全体のサイズ (ドキュメントにクリップされていない、チャンネルデータのサイズ)
+	Size getChannelSize(const Layer& layer)
+	{
+		return Math::Max(Size{layer.right - layer.left, layer.bottom - layer.top}, Size{});
+	}
+
+	Rect intersectRect(const Rect& a, const Rect& b)
+	{
+		const auto tl = Math::Max(a.tl(), b.tl());
+		const auto br = Math::Min(a.br(), b.br());
+		return Rect(tl, Math::Max(br - tl, Size{}));
+	}
+
+	template <class Mask>
+	Rect getMaskRect(const Mask& mask)
+	{
+		return Rect(mask.left, mask.top, Max(mask.right - mask.left, 0), Max(mask.bottom - mask.top, 0));
+	}
+
+	Rect getMaskRect(const Layer& layer, MaskKind kind)
+	{
+		return kind == MaskKind::Layer ? getMaskRect(*layer.layerMask) : getMaskRect(*layer.vectorMask);
+	}
+
+	/// @brief 展開するチャンネルの大きさ (マスクはマスク自身の範囲の大きさ)
+	Size getPlaneSize(const Layer& layer, const LayerChannels& channels, int plane)
+	{
+		if (plane < channels.colorCount) return getChannelSize(layer);
+		for (int i = 0; i < channels.maskCount; ++i)
 		{
-			Image image(imageSize);
-			auto dest = image.data();
-			auto src = colorArray.data() + imageTl.y * props.canvasSize.x + imageTl.x;
-			for (int y = 0; y < imageSize.y; ++y)
-			{
-				memcpy(dest, src, imageSize.x * sizeof(Color));
-				dest += imageSize.x;
-				src += props.canvasSize.x;
-			}
-			return image;
+			if (channels.masks[i].plane == plane) return getMaskRect(layer, channels.masks[i].kind).size;
 		}
+		return Size{};
+	}
 
-		Props props;
+	MaskPlane getMaskPlane(const Layer& layer, MaskKind kind, const uint8* data)
+	{
+		const uint8 defaultColor = kind == MaskKind::Layer ? layer.layerMask->defaultColor : layer.vectorMask->defaultColor;
+		return {getMaskRect(layer, kind), data, defaultColor};
+	}
+
+	/// @brief ファイル内のチャンネルデータの先頭 (ファイル範囲外の場合は nullptr)
+	const uint8* getChannelFileData(const MappedFile& file, const Channel& channel)
+	{
+		if (channel.fileOffset + channel.size > file.size()) return nullptr;
+		return file.data() + channel.fileOffset;
+	}
+
+	/// @brief レイヤーごとの読み込み状態
+	struct LayerJob
+	{
+		/// @brief 色とアルファ、マスクのチャンネル番号
+		LayerChannels channels{};
+
+		/// @brief チャンネルごとの大きさ
+		std::array<Size, MaxLayerPlanes> planeSizes{};
+
+		/// @brief チャンネル単位で展開するか (false の場合は psd_sdk でレイヤー全体を展開)
+		bool splitChannels{};
+
+		/// @brief 展開済みのチャンネルデータ
+		std::array<Array<uint8>, MaxLayerPlanes> channelData{};
+
+		/// @brief channelData の確保を1度だけ行うためのフラグ
+		std::array<std::once_flag, MaxLayerPlanes> channelAllocated{};
+
+		/// @brief 終わっていない作業単位の数
+		std::atomic<int> pendingItems{};
+
+		/// @brief 展開に失敗したチャンネルがあるか
+		std::atomic<bool> failed{};
+
+		/// @brief ファイル内の圧縮されたチャンネルデータのバイト数
+		uint64 compressedBytes{};
+
+		/// @brief 展開後のチャンネルデータのバイト数
+		uint64 decodedBytes{};
+
+		/// @brief 処理コストの見積もり
+		uint64 cost{};
+
+		/// @brief クリッピングの焼き込みが終わるまで画像を保持する土台のレイヤーか
+		bool isClippingBase{};
+	};
+
+	/// @brief ワーカーが取り出す作業単位
+	struct WorkItem
+	{
+		int layerIndex{};
+
+		/// @brief 展開するチャンネル (none の場合はレイヤー全体)
+		Optional<int> channel{};
 
-		MallocAllocator m_allocator{};
-		std::array<Array<uint8>, 4> m_canvasData{};
-		Array<Color> m_colorArray{};
+		/// @brief 展開する行の範囲 [rowBegin, rowEnd)
+		int rowBegin{};
+		int rowEnd{};
 	};
 
-	void LayerImporter::readLayer(int index, PSDLayer& outputLayer)
+	/// @brief レイヤーのメタ情報を読み込み、画素を持つ場合は展開するチャンネル番号を返す
+	Optional<LayerChannels> readLayerInfo(
+		const PSDImporter::Config& config, const Document* document, LayerMaskSection* layerMaskSection, int index,
+		PSDLayer& outputLayer)
 	{
-		Layer* layer = &props.layerMaskSection->layers[index];
-		ExtractLayer(props.document, props.file, &m_allocator, layer);
+		Layer* layer = &layerMaskSection->layers[index];
 
 		// ID情報
 		outputLayer.id = index;
-		outputLayer.parentId = getParentId(layer, props.layerMaskSection);
+		outputLayer.parentId = getParentId(layer, layerMaskSection);
 
 		// 可視情報
 		outputLayer.isVisible = layer->isVisible;
+		outputLayer.opacity = layer->opacity;
+		outputLayer.blendMode = toBlendMode(layer->blendModeKey);
 
 		// フォルダ情報
 		if (layer->type == layerType::OPEN_FOLDER || layer->type == layerType::CLOSED_FOLDER)
@@ -156,263 +383,2225 @@ namespace
 		else if (layer->type == layerType::SECTION_DIVIDER)
 		{
 			outputLayer.error = PSDError(U"Unsupported layer type.");
-			return;
+			return none;
 		}
 
-		// レイヤー名取得
-		std::wstringstream layerName;
+		// レイヤー名取得 (wchar_t が 4 バイトの環境もあるため、UTF-16 として変換する)
 		if (layer->utf16Name)
 		{
-			static_assert(sizeof(wchar_t) == sizeof(uint16)); // In Windows wchar_t is utf16
-			layerName << reinterpret_cast<wchar_t*>(layer->utf16Name);
+			outputLayer.name = Unicode::FromUTF16(std::u16string_view{reinterpret_cast<const char16_t*>(layer->utf16Name)});
 		}
 		else
 		{
-			layerName << layer->name.c_str();
+			outputLayer.name = Unicode::Widen(std::string_view{layer->name.c_str()});
 		}
-		outputLayer.name = Unicode::FromWstring(layerName.str());
 
-		// チャンネル取得
-		const uint32 indexR = findChannel(layer, channelType::R);
-		const uint32 indexG = findChannel(layer, channelType::G);
-		const uint32 indexB = findChannel(layer, channelType::B);
-		const uint32 indexA = findChannel(layer, channelType::TRANSPARENCY_MASK);
-		if ((indexR == invalidChannelValue)
-			|| (indexG == invalidChannelValue)
-			|| (indexB == invalidChannelValue)
-			|| (indexA == invalidChannelValue))
+		// チャンネル取得 (カラーモードごとの色チャンネルとアルファ)
+		LayerChannels channels{};
+		for (const int16 type : getColorChannelTypes(document->colorMode))
 		{
-			if (not outputLayer.isFolder) outputLayer.error = PSDError(U"Invalid RGBA channel.");
-			return;
+			channels.indices[channels.count++] = findChannel(layer, type);
 		}
-
-		// RGB channels were found.
-		expandChannelToCanvas(layer, &layer->channels[indexR], m_canvasData[0], props.canvasSize);
-		expandChannelToCanvas(layer, &layer->channels[indexG], m_canvasData[1], props.canvasSize);
-		expandChannelToCanvas(layer, &layer->channels[indexB], m_canvasData[2], props.canvasSize);
-
-		m_canvasData[3].fill(0);
-		expandChannelToCanvas(layer, &layer->channels[indexA], m_canvasData[3], props.canvasSize);
-
-		if (props.document->bitsPerChannel != 8)
+		channels.indices[channels.count++] = findChannel(layer, channelType::TRANSPARENCY_MASK);
+		if (std::ranges::find(channels.span(), invalidChannelValue) != channels.span().end())
 		{
-			outputLayer.error = PSDError(U"{}-bit / channel is not supported."_fmt(props.document->bitsPerChannel));
-			return;
+			if (not outputLayer.isFolder) outputLayer.error = PSDError(U"Invalid color or alpha channel.");
+			return none;
 		}
 
-		imageUtil::InterleaveRGBA(
-			m_canvasData[0].data(), m_canvasData[1].data(), m_canvasData[2].data(), m_canvasData[3].data(),
-			reinterpret_cast<uint8_t*>(m_colorArray.data()),
-			props.canvasSize.x, props.canvasSize.y);
+		channels.colorCount = channels.count;
 
-		// 配列変換
-		const auto imageTl = getLayerTopLeft(*layer);
-		const auto imageSize = getLayerSize(*layer, props.canvasSize);
-		Image image;
-		if (props.config.marginRemove)
-		{
-			outputLayer.region = Rect(imageTl, imageSize);
-			image = storeImageWithoutMargin(m_colorArray, imageTl, imageSize);
-		}
-		else
+		// アルファに焼き込むマスク (psd_sdk と同じく、ベクトルマスクがある場合のレイヤーマスクは LAYER_MASK)
+		const auto addMask = [&](MaskKind kind, int16 type, StringView name)
 		{
-			outputLayer.region = Rect(props.canvasSize);
-			image = Image(Grid{props.canvasSize, m_colorArray});
-		}
+			auto& mask = channels.masks[channels.maskCount++];
+			mask.kind = kind;
+			if (getMaskRect(*layer, kind).area() == 0) return;
+
+			const uint32 channelIndex = findChannel(layer, type);
+			if (channelIndex == invalidChannelValue)
+			{
+				--channels.maskCount;
+				outputLayer.error = concatError(outputLayer.error, U"Invalid {} channel."_fmt(name));
+				return;
+			}
+			mask.plane = channels.count;
+			channels.indices[channels.count++] = channelIndex;
+		};
 
 		if (layer->layerMask)
 		{
-			outputLayer.error = concatError(outputLayer.error, U"Layer mask is not supported.");
+			if (config.bakeLayerMask)
+			{
+				addMask(
+					MaskKind::Layer,
+					layer->vectorMask ? channelType::LAYER_MASK : channelType::LAYER_OR_VECTOR_MASK,
+					U"layer mask");
+			}
+			else
+			{
+				outputLayer.error = concatError(outputLayer.error, U"Layer mask is not supported.");
+			}
 		}
 
 		if (layer->vectorMask)
 		{
-			outputLayer.error = concatError(outputLayer.error, U"Vector mask is not supported.");
+			if (config.bakeVectorMask)
+			{
+				addMask(MaskKind::Vector, channelType::LAYER_OR_VECTOR_MASK, U"vector mask");
+			}
+			else
+			{
+				outputLayer.error = concatError(outputLayer.error, U"Vector mask is not supported.");
+			}
 		}
 
-		// 格納
-		switch (props.config.storeTarget)
+		return channels;
+	}
+
+	/// @brief クリッピングマスクの土台となるレイヤー (下にある最も近いクリッピングでないレイヤー)
+	Optional<int> findClippingBase(const LayerMaskSection& layerMaskSection, int index)
+	{
+		const Layer& layer = layerMaskSection.layers[index];
+		if (layer.clipping == 0) return none;
+
+		for (int i = index - 1; i >= 0; --i)
 		{
-		case StoreTarget::Image:
-			outputLayer.image = image;
-			break;
-		case StoreTarget::Texture: [[fallthrough]];
-		case StoreTarget::MipmapTexture:
-			outputLayer.texture = DynamicTexture(image, getTextureDesc(props.config.storeTarget));
-			break;
-		case StoreTarget::ImageAndTexture: [[fallthrough]];
-		case StoreTarget::ImageAndMipmapTexture:
-			outputLayer.image = image;
-			outputLayer.texture = DynamicTexture(image, getTextureDesc(props.config.storeTarget));
-			break;
-		default: ;
+			const Layer& below = layerMaskSection.layers[i];
+			if (below.clipping != 0) continue;
+
+			// 同じフォルダ内の通常のレイヤーのみを土台とする (フォルダへのクリッピングはサポートしない)
+			if (below.parent != layer.parent || below.type != layerType::ANY) return none;
+			return i;
 		}
+		return none;
 	}
-}
 
-struct PSDImporter::Impl
-{
-	Config m_config{};
-	PSDError m_error{};
-	PSDObject m_object{};
-	bool m_ready{};
-	Array<AsyncTask<void>> m_threadTasks{};
-	AsyncTask<void> m_importTask{};
-	std::atomic<int> m_nextLayer{};
-
-	void import()
+	/// @brief レイヤーの処理コストと展開方法を決める
+	void prepareLayerJob(
+		const MappedFile& file, const Layer& layer, const LayerChannels& channels, int bytesPerChannel,
+		LayerJob& job)
 	{
-		if (m_config.asyncStart)
+		job.channels = channels;
+		for (int plane = 0; plane < channels.count; ++plane)
 		{
-			m_importTask = Async([this]()
-			{
-				importInternal();
-			});
+			job.planeSizes[plane] = getPlaneSize(layer, channels, plane);
+			job.compressedBytes += layer.channels[channels.indices[plane]].size;
+			job.decodedBytes += static_cast<uint64>(job.planeSizes[plane].area()) * bytesPerChannel;
 		}
-		else
+
+		// 処理コストは圧縮データの読み込み量と展開後のバイト数に比例するとみなす
+		job.cost = job.compressedBytes + job.decodedBytes;
+		job.splitChannels = std::ranges::all_of(channels.span(), [&](uint32 channelIndex)
 		{
-			importInternal();
-		}
+			const Channel& channel = layer.channels[channelIndex];
+			const uint8* src = getChannelFileData(file, channel);
+			if (not src) return false;
+			const auto compression = ChannelDecoder::GetCompression(src, channel.size);
+			return compression && ChannelDecoder::IsDecodable(*compression);
+		});
 	}
 
-private:
-	void importInternal()
+	/// @brief ExtractLayer で確保されたレイヤーのデータを解放
+	void releaseLayerData(Layer& layer, Allocator& allocator)
 	{
-		const std::wstring srcPath = Unicode::ToWstring(m_config.filepath);
-
-		MallocAllocator allocator;
-		NativeFile file(&allocator);
+		for (uint32 i = 0; i < layer.channelCount; ++i)
+		{
+			allocator.Free(layer.channels[i].data);
+			layer.channels[i].data = nullptr;
+		}
 
-		if (not file.OpenRead(srcPath.c_str()))
+		if (layer.layerMask)
 		{
-			m_error = PSDError(U"Cannot open file.");
-			return;
+			allocator.Free(layer.layerMask->data);
+			layer.layerMask->data = nullptr;
 		}
 
-		Document* document = CreateDocument(&file, &allocator);
-		if (not document)
+		if (layer.vectorMask)
 		{
-			m_error = PSDError(U"Cannot create document.");
-			file.Close();
-			return;
+			allocator.Free(layer.vectorMask->data);
+			layer.vectorMask->data = nullptr;
 		}
-		if (document->colorMode != colorMode::RGB)
+	}
+
+	/// @brief 圧縮されたチャンネルデータとレイヤーの大きさのハッシュ (位置と名前を含まないため、画素が同じレイヤーの候補を探すのに使う)
+	uint64 getLayerContentHash(const MappedFile& file, const Layer& layer, const LayerChannels& channels)
+	{
+		const std::array<int32, 2> size{layer.right - layer.left, layer.bottom - layer.top};
+		uint64 hash = Kernel::Hash64(size.data(), sizeof(size));
+		for (const uint32 channelIndex : channels.span())
 		{
-			m_error = PSDError(U"Document is not in RGB color mode.");
-			DestroyDocument(document, &allocator);
-			file.Close();
-			return;
+			const Channel& channel = layer.channels[channelIndex];
+			if (const uint8* src = getChannelFileData(file, channel)) hash = Kernel::Hash64(src, channel.size, hash);
 		}
+		return hash;
+	}
 
-		m_object.documentSize = {document->width, document->height};
+	/// @brief 圧縮されたチャンネルデータ、レイヤー矩形、名前から作るレイヤーの指紋 (再読み込み時に変更の有無を判定する)
+	uint64 getLayerFingerprint(uint64 contentHash, const Layer& layer, const PSDLayer& outputLayer, Size canvasSize)
+	{
+		const std::array<int32, 6> rect{layer.top, layer.left, layer.bottom, layer.right, canvasSize.x, canvasSize.y};
+		const uint64 hash = Kernel::Hash64(rect.data(), sizeof(rect), contentHash);
+		return Kernel::Hash64(outputLayer.name.data(), outputLayer.name.size() * sizeof(char32), hash);
+	}
 
-		// レイヤー情報抽出
-		if (LayerMaskSection* layerMaskSection = ParseLayerMaskSection(document, &file, &allocator))
+	/// @brief レイヤーが保持する画素とテクスチャのおおよそのバイト数
+	size_t estimateLayerBytes(const PSDLayer& layer, StoreTarget storeTarget)
+	{
+		size_t bytes = layer.image.size_bytes() + layer.compressedImage.size_bytes() + layer.floatImage.size_bytes();
+		if (not layer.texture.isEmpty())
 		{
-			extractLayers(&allocator, &file, document, layerMaskSection, m_object.documentSize);
+			const size_t textureBytes = static_cast<size_t>(layer.texture.width()) * layer.texture.height() * sizeof(Color);
 
-			DestroyLayerMaskSection(layerMaskSection, &allocator);
-		}
-		else
-		{
-			m_error = PSDError(U"Layers and masks are missing.");
+			// ミップマップは元の 1/3 程度
+			bytes += getTextureDesc(storeTarget) == TextureDesc::Mipped ? textureBytes * 4 / 3 : textureBytes;
 		}
-
-		DestroyDocument(document, &allocator);
-		file.Close();
+		return bytes;
 	}
 
-	void extractLayers(
-		MallocAllocator* allocator,
-		NativeFile* file,
-		Document* document,
-		LayerMaskSection* layerMaskSection,
-		const Size& canvasSize)
+	/// @brief 画像を読み込み時の設定に応じてレイヤーに格納
+	/// @param keepImage 格納先にかかわらず画像を保持するか (キャッシュファイルへの書き出し用)
+	/// @param sharedTexture 画素が同じレイヤーのテクスチャ (指定した場合はテクスチャを作らずに共有する)
+	void storeImage(
+		const PSDImporter::Config& config, const Image& image, bool keepImage, PSDLayer& outputLayer,
+		const DynamicTexture* sharedTexture = nullptr)
 	{
-		const int layerCount = layerMaskSection->layerCount;
-		m_object.layers.resize(layerCount);
+		// すべて透明で切り詰められたレイヤーはテクスチャを作らない
+		if (image.isEmpty()) return;
 
-		// スレッドごとにレイヤー処理
-		for (int id = 0; id < std::min(m_config.maxThreads, layerCount); ++id)
+		const auto makeTexture = [&]()
 		{
-			m_threadTasks.emplace_back(Async(
-				[this, allocator, file, document, layerMaskSection, canvasSize, id]()
-				{
-					extractLayersAsync(file, document, layerMaskSection, canvasSize, m_nextLayer, id);
-				}));
+			return sharedTexture ? *sharedTexture : DynamicTexture(image, getTextureDesc(config.storeTarget));
+		};
+		switch (config.storeTarget)
+		{
+		case StoreTarget::Image:
+			outputLayer.image = image;
+			break;
+		case StoreTarget::Texture: [[fallthrough]];
+		case StoreTarget::MipmapTexture:
+			if (keepImage) outputLayer.image = image;
+			outputLayer.texture = makeTexture();
+			break;
+		case StoreTarget::ImageAndTexture: [[fallthrough]];
+		case StoreTarget::ImageAndMipmapTexture:
+			outputLayer.image = image;
+			outputLayer.texture = makeTexture();
+			break;
+		case StoreTarget::AtlasTexture: [[fallthrough]];
+		case StoreTarget::ImageAndAtlasTexture:
+			// アトラスへの詰め込みは全レイヤーの展開後に行う
+			outputLayer.image = image;
+			if (not isAtlasStore(config)) outputLayer.texture = makeTexture();
+			break;
+		case StoreTarget::CompressedImage:
+			if (keepImage) outputLayer.image = image;
+			outputLayer.compressedImage = CompressedImage{image};
+			break;
+		default: ;
 		}
-
-		// 終了チェック
-		for (auto&& t : m_threadTasks) t.wait();
-		m_ready = true;
 	}
 
-	void extractLayersAsync(
-		NativeFile* file,
-		Document* document,
-		LayerMaskSection* layerMaskSection,
-		const Size& canvasSize,
-		std::atomic<int>& nextLayer,
-		int threadId)
+	void multiplyAlpha(Color* dest, const uint8* mask, size_t count)
 	{
-		// Stopwatch sw{};
-		// sw.start();
-		// Console.writeln(U"Thread {} start"_fmt(threadId));
-		LayerImporter layerReader{
-			{
-				.config = m_config,
-				.file = file,
-				.document = document,
-				.layerMaskSection = layerMaskSection,
-				.canvasSize = canvasSize,
-			}
-		};
+		Kernel::MultiplyAlpha(dest, mask, count);
+	}
 
-		while (true)
-		{
-			const int nextIndex = nextLayer.fetch_add(1);
-			if (nextIndex >= m_object.layers.size()) break;
-			layerReader.readLayer(nextIndex, m_object.layers[nextIndex]);
-		}
-		// Console.writeln(U"Thread {}: {}"_fmt(threadId, sw.sF()));
+	void multiplyAlpha(Color* dest, uint8 value, size_t count)
+	{
+		Kernel::MultiplyAlpha(dest, value, count);
 	}
-};
 
-namespace SivPSD
-{
-	PSDImporter::PSDImporter() : PSDImporter(Config())
+	void multiplyAlpha(Color* dest, const Color* src, size_t count)
 	{
+		Kernel::MultiplyAlpha(dest, src, count);
 	}
 
-	PSDImporter::PSDImporter(const FilePath& filepath) : PSDImporter(Config{
-		.filepath = filepath
-	})
+	void multiplyAlpha(Float4* dest, const uint8* mask, size_t count)
 	{
+		for (size_t i = 0; i < count; ++i) dest[i].w *= mask[i] / 255.0f;
 	}
 
-	PSDImporter::PSDImporter(const Config& config) :
-		p_impl(std::make_shared<Impl>())
+	void multiplyAlpha(Float4* dest, uint8 value, size_t count)
 	{
-		p_impl->m_config = config;
-		p_impl->import();
+		if (value == 255) return;
+		for (size_t i = 0; i < count; ++i) dest[i].w *= value / 255.0f;
 	}
 
-	Optional<PSDError> PSDImporter::getCriticalError() const
+	void multiplyAlpha(Float4* dest, const Color* src, size_t count)
 	{
-		return p_impl->m_ready || p_impl->m_error.what().empty()
-			       ? none
-			       : Optional<PSDError>(p_impl->m_error);
+		for (size_t i = 0; i < count; ++i) dest[i].w *= src[i].a / 255.0f;
 	}
 
-	PSDObject PSDImporter::getObject() const
+	/// @brief マスクの1行を 8 ビットで返す (16/32 ビットのドキュメントでは buffer に変換する)
+	const uint8* getMaskRow8(const MaskPlane& mask, int bytesPerChannel, Point pos, int count, Array<uint8>& buffer)
 	{
-		return p_impl->m_ready
-			       ? p_impl->m_object
-			       : PSDObject{};
+		const size_t offset = static_cast<size_t>(pos.y - mask.rect.y) * mask.rect.w + (pos.x - mask.rect.x);
+		if (bytesPerChannel == 1) return mask.data + offset;
+
+		buffer.resize(count);
+		if (bytesPerChannel == 2)
+		{
+			const auto src = reinterpret_cast<const uint16*>(mask.data) + offset;
+			for (int i = 0; i < count; ++i) buffer[i] = static_cast<uint8>((src[i] * 255u + 32767u) / 65535u);
+		}
+		else
+		{
+			const auto src = reinterpret_cast<const float*>(mask.data) + offset;
+			for (int i = 0; i < count; ++i) buffer[i] = static_cast<uint8>(Clamp(src[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+		return buffer.data();
 	}
 
-	bool PSDImporter::isReady() const noexcept
+	/// @brief マスクを画素のアルファに乗算する (マスクの範囲外は既定値を乗算する)
+	/// @param imageTl dest の先頭画素のドキュメント座標
+	template <class Dest>
+	void bakeMask(
+		const MaskPlane& mask, int bytesPerChannel, Point imageTl, Size imageSize, Dest* dest, int destStride)
 	{
-		return p_impl->m_ready;
+		const Rect overlap = intersectRect(Rect(imageTl, imageSize), mask.rect);
+		const int left = overlap.x - imageTl.x;
+		const int right = left + overlap.w;
+		Array<uint8> buffer{};
+		for (int y = 0; y < imageSize.y; ++y, dest += destStride)
+		{
+			const int documentY = imageTl.y + y;
+			if (overlap.area() == 0 || documentY < overlap.y || overlap.bottomY() <= documentY)
+			{
+				multiplyAlpha(dest, mask.defaultColor, imageSize.x);
+				continue;
+			}
+
+			multiplyAlpha(dest, mask.defaultColor, left);
+			multiplyAlpha(
+				dest + left, getMaskRow8(mask, bytesPerChannel, {overlap.x, documentY}, overlap.w, buffer), overlap.w);
+			multiplyAlpha(dest + right, mask.defaultColor, imageSize.x - right);
+		}
+	}
+
+	/// @brief クリッピングされたレイヤーの画素のアルファに土台のレイヤーのアルファを乗算する (土台の外側は透明になる)
+	template <class Dest>
+	void bakeClippingRows(const PSDLayer& base, const Rect& region, Dest* dest)
+	{
+		const Rect overlap = intersectRect(region, base.region);
+		const int left = overlap.x - region.x;
+		const int right = left + overlap.w;
+		for (int y = 0; y < region.h; ++y, dest += region.w)
+		{
+			const int documentY = region.y + y;
+			if (overlap.area() == 0 || documentY < overlap.y || overlap.bottomY() <= documentY)
+			{
+				multiplyAlpha(dest, uint8{0}, region.w);
+				continue;
+			}
+
+			const Point basePos = Point{overlap.x, documentY} - base.region.pos;
+			multiplyAlpha(dest, uint8{0}, left);
+			multiplyAlpha(dest + left, base.image.data() + basePos.y * base.image.width() + basePos.x, overlap.w);
+			multiplyAlpha(dest + right, uint8{0}, region.w - right);
+		}
+	}
+
+	/// @brief レイヤーの画素配列 (image と layer.floatImage) をレイヤー内の範囲 clip に切り詰める
+	void clipLayer(const Rect& clip, Image& image, PSDLayer& layer)
+	{
+		image = image.clipped(clip);
+		if (not layer.floatImage.isEmpty())
+		{
+			Grid<Float4> floatImage(clip.size);
+			for (int y = 0; y < clip.h; ++y)
+			{
+				std::copy_n(
+					layer.floatImage.data() + (clip.y + y) * layer.floatImage.width() + clip.x, clip.w,
+					floatImage.data() + y * clip.w);
+			}
+			layer.floatImage = std::move(floatImage);
+		}
+		layer.region = clip.movedBy(layer.region.pos);
+	}
+
+	/// @brief アルファが 0 でない画素を囲む範囲に切り詰め、すべて透明な場合は画素を持たない空のレイヤーにする
+	void trimTransparent(Image& image, PSDLayer& layer)
+	{
+		const auto bounds = Kernel::FindAlphaBounds(image.data(), image.size(), image.width());
+		if (not bounds)
+		{
+			image = Image{};
+			layer.floatImage = Grid<Float4>{};
+			layer.region.size = Size{};
+			layer.isBlank = true;
+		}
+		else if (*bounds != Rect(image.size()))
+		{
+			clipLayer(*bounds, image, layer);
+		}
+	}
+
+	/// @brief クリッピングを焼き込み、余白を除く場合は土台と重なる範囲に切り詰める
+	void bakeClipping(const PSDLayer& base, const PSDImporter::Config& config, PSDLayer& layer)
+	{
+		bakeClippingRows(base, layer.region, layer.image.data());
+		if (not layer.floatImage.isEmpty()) bakeClippingRows(base, layer.region, layer.floatImage.data());
+		if (not config.marginRemove) return;
+
+		const Rect overlap = intersectRect(layer.region, base.region);
+		clipLayer(overlap.movedBy(-layer.region.pos), layer.image, layer);
+
+		// 土台のアルファで透明になった範囲も除く
+		if (isTrimStore(config)) trimTransparent(layer.image, layer);
+	}
+
+	/// @brief 画素のハッシュの初期値 (大きさが異なる画像は一致させない)
+	uint64 getImageHashSeed(Size size)
+	{
+		const std::array<int32, 2> values{size.x, size.y};
+		return Kernel::Hash64(values.data(), sizeof(values));
+	}
+
+	/// @brief 行ごとの Hash64 を seed から順につなげる (インターリーブ中に帯ごとに求めた値と hashImage は一致する)
+	uint64 hashRows(const Color* rows, int width, int rowCount, uint64 seed)
+	{
+		for (int y = 0; y < rowCount; ++y, rows += width) seed = Kernel::Hash64(rows, width * sizeof(Color), seed);
+		return seed;
+	}
+
+	/// @brief 格納する画素のハッシュ (大きさを含む)
+	uint64 hashImage(const Image& image)
+	{
+		return hashRows(image.data(), image.width(), image.height(), getImageHashSeed(image.size()));
+	}
+
+	/// @brief 画素が同じレイヤーにテクスチャを共有させるための表 (比較のため、登録したレイヤーの画像を読み込み中のみ保持する)
+	class LayerDeduplicator
+	{
+	public:
+		struct Match
+		{
+			int layerIndex;
+			DynamicTexture texture;
+		};
+
+		/// @brief ハッシュと画素が一致する登録済みのレイヤー
+		[[nodiscard]]
+		Optional<Match> find(uint64 hash, const Image& image) const
+		{
+			std::lock_guard lock{m_mutex};
+			const auto it = m_entries.find(hash);
+			if (it == m_entries.end()) return none;
+
+			// ハッシュの衝突に備えて画素を比較する
+			for (const auto& entry : it->second)
+			{
+				if (entry.image.size() == image.size()
+					&& std::memcmp(entry.image.data(), image.data(), image.size_bytes()) == 0)
+				{
+					return Match{entry.layerIndex, entry.texture};
+				}
+			}
+			return none;
+		}
+
+		void add(uint64 hash, int layerIndex, Image&& image, const DynamicTexture& texture)
+		{
+			std::lock_guard lock{m_mutex};
+			m_entries[hash].push_back(Entry{layerIndex, std::move(image), texture});
+		}
+
+		/// @brief テクスチャを共有したレイヤーを記録する
+		void recordShared(uint64 savedBytes)
+		{
+			std::lock_guard lock{m_mutex};
+			++m_stats.sharedLayers;
+			m_stats.savedTextureBytes += savedBytes;
+		}
+
+		/// @brief 比較用に保持している画像を破棄する (共有の記録は残す)
+		void clear()
+		{
+			std::lock_guard lock{m_mutex};
+			m_entries.clear();
+		}
+
+		void reset()
+		{
+			std::lock_guard lock{m_mutex};
+			m_entries.clear();
+			m_stats = {};
+		}
+
+		[[nodiscard]]
+		PSDImporter::DedupStats stats() const
+		{
+			std::lock_guard lock{m_mutex};
+			return m_stats;
+		}
+
+	private:
+		struct Entry
+		{
+			int layerIndex;
+			Image image;
+			DynamicTexture texture;
+		};
+
+		mutable std::mutex m_mutex{};
+		std::unordered_map<uint64, Array<Entry>> m_entries{};
+		PSDImporter::DedupStats m_stats{};
+	};
+
+	/// @brief テクスチャを共有して削減できるバイト数 (ミップマップは元の 1/3 程度)
+	uint64 getSharedTextureBytes(const PSDImporter::Config& config, const Image& image)
+	{
+		const uint64 bytes = image.size_bytes();
+		return getTextureDesc(config.storeTarget) == TextureDesc::Mipped ? bytes * 4 / 3 : bytes;
+	}
+
+	/// @brief 画素が同じ格納済みのレイヤーがあればテクスチャを共有して格納し、なければ格納してから登録する
+	void storeDeduplicated(
+		const PSDImporter::Config& config, uint64 hash, Image&& image, bool keepImage, int layerIndex,
+		PSDLayer& outputLayer, LayerDeduplicator& deduplicator)
+	{
+		if (image.isEmpty()) return;
+
+		if (const auto match = deduplicator.find(hash, image))
+		{
+			storeImage(config, image, keepImage, outputLayer, &match->texture);
+			outputLayer.sharedTextureId = match->layerIndex;
+			deduplicator.recordShared(getSharedTextureBytes(config, image));
+			return;
+		}
+		storeImage(config, image, keepImage, outputLayer);
+		deduplicator.add(hash, layerIndex, std::move(image), outputLayer.texture);
+	}
+
+	/// @brief 展開済みレイヤーを最近使われた順に保持し、容量を超えたら古いものから破棄するキャッシュ
+	class DecodedLayerCache
+	{
+	public:
+		void setCapacity(size_t capacity)
+		{
+			m_capacity = capacity;
+		}
+
+		void clear()
+		{
+			m_lru.clear();
+			m_entries.clear();
+			m_usedBytes = 0;
+		}
+
+		[[nodiscard]]
+		size_t usedBytes() const noexcept
+		{
+			return m_usedBytes;
+		}
+
+		/// @brief キャッシュされたレイヤー (見つかった場合は最近使われたものとして扱います)
+		const PSDLayer* find(int id)
+		{
+			const auto it = m_entries.find(id);
+			if (it == m_entries.end()) return nullptr;
+
+			m_lru.splice(m_lru.begin(), m_lru, it->second.lruPosition);
+			return &it->second.layer;
+		}
+
+		void insert(int id, const PSDLayer& layer, StoreTarget storeTarget)
+		{
+			const size_t bytes = estimateLayerBytes(layer, storeTarget);
+			m_lru.push_front(id);
+			m_entries.emplace(id, Entry{layer, bytes, m_lru.begin()});
+			m_usedBytes += bytes;
+
+			// 追加したばかりのレイヤーは残す
+			while (m_usedBytes > m_capacity && m_lru.size() > 1)
+			{
+				const auto it = m_entries.find(m_lru.back());
+				m_usedBytes -= it->second.bytes;
+				m_entries.erase(it);
+				m_lru.pop_back();
+			}
+		}
+
+	private:
+		struct Entry
+		{
+			PSDLayer layer;
+			size_t bytes;
+			std::list<int>::iterator lruPosition;
+		};
+
+		size_t m_capacity{};
+		size_t m_usedBytes{};
+
+		/// @brief 先頭が最近使われたレイヤー
+		std::list<int> m_lru{};
+
+		std::unordered_map<int, Entry> m_entries{};
+	};
+
+	/// @brief 8 ビットのチャンネルの1行をカラーモードに応じて RGBA に変換
+	void interleaveRow8(uint32 mode, const ChannelDataArray& src, Color* dest, size_t count)
+	{
+		switch (mode)
+		{
+		case colorMode::GRAYSCALE:
+			Kernel::InterleaveGray(src[0], src[1], dest, count);
+			return;
+		case colorMode::CMYK:
+			Kernel::InterleaveCMYK(src[0], src[1], src[2], src[3], src[4], dest, count);
+			return;
+		case colorMode::LAB:
+			Kernel::InterleaveLab(src[0], src[1], src[2], src[3], dest, count);
+			return;
+		default:
+			Kernel::InterleaveRGBA(src[0], src[1], src[2], src[3], dest, count);
+			return;
+		}
+	}
+
+	uint16 readUint16BE(const uint8* p)
+	{
+		return static_cast<uint16>((p[0] << 8) | p[1]);
+	}
+
+	uint32 readUint32BE(const uint8* p)
+	{
+		return (static_cast<uint32>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	}
+
+	/// @brief 画像リソースのバージョン情報から、統合画像が保存されているかを判定する (見つからない場合は保存されているとみなす)
+	bool hasRealMergedData(const MappedFile& file, const Document& document)
+	{
+		const Section& section = document.imageResourcesSection;
+		if (section.offset + section.length > file.size()) return false;
+
+		constexpr uint16 versionInfoId = 1057;
+		const uint8* p = file.data() + section.offset;
+		const uint8* end = p + section.length;
+		while (end - p >= 12 && std::memcmp(p, "8BIM", 4) == 0)
+		{
+			const uint16 id = readUint16BE(p + 4);
+
+			// 名前のパスカル文字列は長さのバイトを含めて偶数バイトに揃えられている
+			p += 6 + ((p[6] + 2) & ~1);
+			if (end - p < 4) break;
+			const uint32 size = readUint32BE(p);
+			p += 4;
+			if (static_cast<uint32>(end - p) < size) break;
+
+			// バージョン (4 バイト) の後に統合画像を持つかのフラグが続く
+			if (id == versionInfoId && size >= 5) return p[4] != 0;
+			p += (size + 1) & ~1u;
+		}
+		return true;
+	}
+
+	/// @brief 統合画像の色チャンネルの次のチャンネルが透明度か (レイヤー数が負の値で保存されている場合)
+	bool hasMergedAlpha(const MappedFile& file, const Document& document)
+	{
+		if (document.channelCount <= getColorChannelTypes(document.colorMode).size()) return false;
+
+		const Section& section = document.layerMaskInfoSection;
+		if (section.length < 6 || section.offset + 6 > file.size()) return false;
+
+		// レイヤー情報の長さの後にレイヤー数が続く
+		const uint8* p = file.data() + section.offset;
+		return readUint32BE(p) != 0 && static_cast<int16>(readUint16BE(p + 4)) < 0;
+	}
+
+	/// @brief 白を背景に合成されて保存された統合画像の色を、アルファで割って元に戻す
+	void unmatteWhite(Color* pixels, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Color& c = pixels[i];
+			if (c.a == 0 || c.a == 255) continue;
+
+			const int background = 255 - c.a;
+			const auto unmatte = [&](uint8 v)
+			{
+				return static_cast<uint8>(Clamp((static_cast<int>(v) - background) * 255 / c.a, 0, 255));
+			};
+			c.r = unmatte(c.r);
+			c.g = unmatte(c.g);
+			c.b = unmatte(c.b);
+		}
+	}
+
+	/// @brief 画像データセクションの統合画像を、行の帯ごとに並列で展開する
+	Optional<Image> decodeMergedImage(
+		const MappedFile& file, const Document& document, const PSDImporter::Config& config, WorkerPool& pool)
+	{
+		if (not hasRealMergedData(file, document)) return none;
+
+		const uint64 offset = document.imageDataSection.offset;
+		if (offset >= file.size()) return none;
+		const uint8* src = file.data() + offset;
+		const size_t srcSize = static_cast<size_t>(file.size() - offset);
+		const auto compression = ChannelDecoder::GetCompression(src, srcSize);
+		if (not compression || not ChannelDecoder::IsDecodable(*compression)) return none;
+
+		const int colorCount = static_cast<int>(getColorChannelTypes(document.colorMode).size());
+		const bool hasAlpha = hasMergedAlpha(file, document);
+		const int planeCount = colorCount + (hasAlpha ? 1 : 0);
+		const Size size{static_cast<int32>(document.width), static_cast<int32>(document.height)};
+		const int bytesPerChannel = getBytesPerChannel(&document);
+		const size_t rowBytes = static_cast<size_t>(size.x) * bytesPerChannel;
+
+		// 透明度を持たない場合は不透明の行で補う
+		Array<uint8> opaqueRow(rowBytes, uint8{0xFF});
+		if (bytesPerChannel == 4) std::fill_n(reinterpret_cast<float*>(opaqueRow.data()), size.x, 1.0f);
+
+		Image image(size);
+		std::array<Array<uint8>, MaxLayerChannels> planes{};
+		for (int c = 0; c < planeCount; ++c) planes[c].resize(rowBytes * size.y);
+
+		std::atomic<bool> failed{};
+		const auto decodeBand = [&](int rowBegin, int rowEnd)
+		{
+			for (int c = 0; c < planeCount; ++c)
+			{
+				if (not ChannelDecoder::DecodeImageDataRows(
+					src, srcSize, rowBytes, size.y, document.channelCount, c, rowBegin, rowEnd, planes[c].data()))
+				{
+					failed = true;
+					return;
+				}
+
+				uint8* rows = planes[c].data() + rowBytes * rowBegin;
+				const size_t count = static_cast<size_t>(size.x) * (rowEnd - rowBegin);
+				if (bytesPerChannel == 2) Kernel::SwapBytes(reinterpret_cast<uint16*>(rows), count);
+				else if (bytesPerChannel == 4) Kernel::SwapBytes(reinterpret_cast<uint32*>(rows), count);
+			}
+
+			for (int y = rowBegin; y < rowEnd; ++y)
+			{
+				ChannelDataArray row{};
+				for (int c = 0; c < colorCount; ++c) row[c] = planes[c].data() + rowBytes * y;
+				row[colorCount] = hasAlpha ? planes[colorCount].data() + rowBytes * y : opaqueRow.data();
+
+				Color* dest = image[y];
+				const Optional<int32> ditherRow = config.dither ? Optional<int32>{y} : Optional<int32>{};
+				switch (bytesPerChannel)
+				{
+				case 2:
+					Kernel::InterleaveRGBA(
+						reinterpret_cast<const uint16*>(row[0]), reinterpret_cast<const uint16*>(row[1]),
+						reinterpret_cast<const uint16*>(row[2]), reinterpret_cast<const uint16*>(row[3]),
+						dest, size.x, ditherRow);
+					break;
+				case 4:
+					Kernel::InterleaveRGBA(
+						reinterpret_cast<const float*>(row[0]), reinterpret_cast<const float*>(row[1]),
+						reinterpret_cast<const float*>(row[2]), reinterpret_cast<const float*>(row[3]),
+						dest, size.x, ditherRow);
+					break;
+				default:
+					interleaveRow8(document.colorMode, row, dest, size.x);
+					break;
+				}
+				if (hasAlpha) unmatteWhite(dest, size.x);
+			}
+		};
+
+		const int bandCount = Max(1, Min(config.maxThreads, size.y));
+		pool.parallelFor(bandCount, config.maxThreads, [&](size_t band)
+		{
+			const int b = static_cast<int>(band);
+			decodeBand(size.y * b / bandCount, size.y * (b + 1) / bandCount);
+		});
+
+		if (failed) return none;
+		return image;
+	}
+
+	/// @brief コストの大きいレイヤーから順に作業単位を並べる
+	Array<WorkItem> scheduleWorkItems(
+		const PSDImporter::Config& config,
+		const LayerMaskSection& layerMaskSection,
+		Array<LayerJob>& jobs,
+		const Array<int>& pixelLayers)
+	{
+		Array<int> order = pixelLayers;
+		order.stable_sort_by([&](int a, int b) { return jobs[a].cost > jobs[b].cost; });
+
+		Array<WorkItem> workItems{};
+		for (const int index : order)
+		{
+			auto& job = jobs[index];
+			const Size channelSize = job.planeSizes[0];
+			if (not job.splitChannels)
+			{
+				workItems.push_back({index, none, 0, channelSize.y});
+				job.pendingItems = 1;
+				continue;
+			}
+
+			// 大きなレイヤーも複数コアに分散できるようにチャンネルごとに分割し、
+			// 特に大きなレイヤーはさらに行の帯に分割する
+			const bool splitRows = static_cast<int64>(channelSize.x) * channelSize.y > config.rowSplitThreshold;
+			const int bandCount = splitRows ? Max(1, Min(config.maxThreads, channelSize.y)) : 1;
+			for (int channel = 0; channel < job.channels.count; ++channel)
+			{
+				// マスクは大きさが異なるため、それぞれの行数で分割する
+				const int rows = job.planeSizes[channel].y;
+				for (int band = 0; band < bandCount; ++band)
+				{
+					workItems.push_back({
+						index,
+						channel,
+						rows * band / bandCount,
+						rows * (band + 1) / bandCount
+					});
+				}
+			}
+			job.pendingItems = job.channels.count * bandCount;
+		}
+		return workItems;
+	}
+
+	/// @brief インターリーブとマスクの焼き込み、行のハッシュをまとめて行う帯の行数 (書き込んだ行がキャッシュに残る程度)
+	constexpr int InterleaveBandRows = 16;
+
+	/// @brief 特に大きなドキュメントの後に、スレッドが作業用メモリを保持し続けないための上限
+	constexpr size_t MaxRetainedScratchBytes = 256 * 1024 * 1024;
+
+	/// @brief スレッドが保持し、読み込みをまたいで使い回すチャンネルデータのバッファ
+	class ScratchBuffers
+	{
+	public:
+		/// @brief bytes 以上の容量を持つバッファを取り出す (なければ最も大きいものを広げる)
+		Array<uint8> acquire(size_t bytes)
+		{
+			if (m_buffers.empty())
+			{
+				Array<uint8> buffer{};
+				buffer.resize(bytes);
+				return buffer;
+			}
+
+			size_t best = 0;
+			for (size_t i = 1; i < m_buffers.size(); ++i)
+			{
+				const size_t capacity = m_buffers[i].capacity();
+				const size_t bestCapacity = m_buffers[best].capacity();
+				const bool fits = capacity >= bytes;
+				const bool bestFits = bestCapacity >= bytes;
+				if ((fits && (not bestFits || capacity < bestCapacity)) || (not fits && not bestFits && capacity > bestCapacity))
+				{
+					best = i;
+				}
+			}
+
+			Array<uint8> buffer = std::move(m_buffers[best]);
+			m_buffers.erase(m_buffers.begin() + best);
+			m_retainedBytes -= buffer.capacity();
+			buffer.resize(bytes);
+			return buffer;
+		}
+
+		void recycle(Array<uint8>&& buffer)
+		{
+			if (buffer.capacity() == 0 || m_buffers.size() >= MaxBuffers) return;
+			if (m_retainedBytes + buffer.capacity() > MaxRetainedScratchBytes) return;
+			m_retainedBytes += buffer.capacity();
+			m_buffers.push_back(std::move(buffer));
+		}
+
+	private:
+		static constexpr size_t MaxBuffers = MaxLayerPlanes * 2;
+
+		Array<Array<uint8>> m_buffers{};
+		size_t m_retainedBytes{};
+	};
+
+	/// @brief スレッドごとの作業用メモリ (プールのワーカーでは読み込みをまたいで保持される)
+	struct WorkerScratch
+	{
+		/// @brief psd_sdk でレイヤー全体を展開する際の確保先 (1レイヤーごとにまとめて解放する)
+		ArenaAllocator allocator{1024 * 1024};
+
+		ScratchBuffers buffers{};
+	};
+
+	WorkerScratch& getWorkerScratch()
+	{
+		thread_local WorkerScratch scratch{};
+		return scratch;
+	}
+
+	// スレッドごとに作成
+	class LayerImporter
+	{
+	public:
+		struct Props
+		{
+			PSDImporter::Config config;
+			MappedFile* file;
+			Document* document;
+			LayerMaskSection* layerMaskSection;
+			Size canvasSize;
+
+			/// @brief 格納先にかかわらず画像を保持するか (キャッシュファイルへの書き出し用)
+			bool retainImages;
+
+			/// @brief クリッピングされたレイヤーは全レイヤーの展開後に焼き込むため、画像のみを格納するか
+			bool bakesClipping;
+
+			/// @brief 画素が同じレイヤーとテクスチャを共有するための表 (共有しない場合は nullptr)
+			LayerDeduplicator* deduplicator;
+		};
+
+		/// @param stats 呼び出し元スレッドの計測の記録 (計測しない場合は nullptr)
+		LayerImporter(Props props, ImportStatsRecorder::ThreadRecord* stats = nullptr) :
+			props(std::move(props)), m_stats(stats), m_scratch(getWorkerScratch())
+		{
+		}
+
+		/// @brief 作業単位を処理し、それによってレイヤーが完成したかを返す
+		bool processWorkItem(const WorkItem& item, LayerJob& job, PSDLayer& outputLayer);
+
+	private:
+		/// @brief レイヤー領域のみを RGBA にインターリーブし dest に直接書き込む
+		/// @tparam Dest Color (8 ビットに変換) または Float4 (16/32 ビットの精度を保つ)
+		template <class Dest>
+		void interleaveLayer(
+			const Layer& layer,
+			const ChannelDataArray& channelData,
+			Point imageTl,
+			Size imageSize,
+			Dest* dest,
+			int destStride) const
+		{
+			switch (getBytesPerChannel(props.document))
+			{
+			case 2:
+				interleaveRows<uint16>(layer, channelData, imageTl, imageSize, dest, destStride);
+				return;
+			case 4:
+				interleaveRows<float>(layer, channelData, imageTl, imageSize, dest, destStride);
+				return;
+			default:
+				if constexpr (std::is_same_v<Dest, Color>)
+				{
+					interleaveRows<uint8>(layer, channelData, imageTl, imageSize, dest, destStride);
+				}
+				return;
+			}
+		}
+
+		template <class Source, class Dest>
+		void interleaveRows(
+			const Layer& layer,
+			const ChannelDataArray& channelData,
+			Point imageTl,
+			Size imageSize,
+			Dest* dest,
+			int destStride) const
+		{
+			const int channelWidth = layer.right - layer.left;
+			std::array<const Source*, MaxLayerChannels> src{};
+			for (size_t c = 0; c < src.size(); ++c)
+			{
+				if (not channelData[c]) continue;
+				src[c] = reinterpret_cast<const Source*>(getClippedChannelData(layer, channelData[c], imageTl, sizeof(Source)));
+			}
+
+			for (int y = 0; y < imageSize.y; ++y)
+			{
+				if constexpr (std::is_same_v<Source, uint8>)
+				{
+					interleaveRow8(props.document->colorMode, src, dest, imageSize.x);
+				}
+				else if constexpr (std::is_same_v<Dest, Float4>)
+				{
+					Kernel::InterleaveRGBA(src[0], src[1], src[2], src[3], dest, imageSize.x);
+				}
+				else
+				{
+					// 丸め誤差をドキュメント上の行ごとに異なるパターンで散らす
+					const Optional<int32> ditherRow = props.config.dither ? Optional<int32>{imageTl.y + y} : Optional<int32>{};
+					Kernel::InterleaveRGBA(src[0], src[1], src[2], src[3], dest, imageSize.x, ditherRow);
+				}
+				for (auto& s : src)
+				{
+					if (s) s += channelWidth;
+				}
+				dest += destStride;
+			}
+		}
+
+		/// @param job クリッピングの土台か (焼き込みまで画像を保持する) を参照する
+		void storeLayer(
+			int layerIndex,
+			const Layer& layer,
+			const ChannelDataArray& channelData,
+			std::span<const MaskPlane> masks,
+			const LayerJob& job,
+			PSDLayer& outputLayer) const;
+
+		/// @brief 展開したチャンネルデータと仕上げた画素配列を作業用メモリとして記録
+		void recordScratch(const LayerJob& job, const PSDLayer& outputLayer) const
+		{
+			if (not m_stats) return;
+			m_stats->addScratch(
+				job.decodedBytes + outputLayer.region.area() * sizeof(Color) + outputLayer.floatImage.size_bytes());
+		}
+
+		Props props;
+
+		ImportStatsRecorder::ThreadRecord* m_stats;
+
+		WorkerScratch& m_scratch;
+	};
+
+	bool LayerImporter::processWorkItem(const WorkItem& item, LayerJob& job, PSDLayer& outputLayer)
+	{
+		Layer* layer = &props.layerMaskSection->layers[item.layerIndex];
+		const auto& indices = job.channels.indices;
+
+		if (not item.channel)
+		{
+			// psd_sdk でレイヤー全体を展開
+			{
+				PhaseTimer timer{m_stats, ImportPhase::Decode, item.layerIndex};
+				ExtractLayer(props.document, props.file, &m_scratch.allocator, layer);
+			}
+			if (m_stats)
+			{
+				m_stats->bytesRead += job.compressedBytes;
+				m_stats->bytesDecompressed += job.decodedBytes;
+			}
+
+			ChannelDataArray channelData{};
+			for (int c = 0; c < job.channels.colorCount; ++c)
+			{
+				channelData[c] = static_cast<const uint8*>(layer->channels[indices[c]].data);
+			}
+			std::array<MaskPlane, 2> masks{};
+			for (int i = 0; i < job.channels.maskCount; ++i)
+			{
+				const MaskKind kind = job.channels.masks[i].kind;
+				const void* data = kind == MaskKind::Layer ? layer->layerMask->data : layer->vectorMask->data;
+				masks[i] = getMaskPlane(*layer, kind, static_cast<const uint8*>(data));
+			}
+			storeLayer(
+				item.layerIndex, *layer, channelData, std::span{masks.data(), static_cast<size_t>(job.channels.maskCount)},
+				job, outputLayer);
+			recordScratch(job, outputLayer);
+			releaseLayerData(*layer, m_scratch.allocator);
+			m_scratch.allocator.reset(MaxRetainedScratchBytes);
+			return true;
+		}
+
+		// 1チャンネルの指定された行のみ展開
+		const int channelIndex = *item.channel;
+		const Channel& channel = layer->channels[indices[channelIndex]];
+		const Size channelSize = job.planeSizes[channelIndex];
+		const int bytesPerChannel = getBytesPerChannel(props.document);
+		const size_t rowBytes = static_cast<size_t>(channelSize.x) * bytesPerChannel;
+		auto& data = job.channelData[channelIndex];
+		std::call_once(job.channelAllocated[channelIndex], [&]()
+		{
+			data = m_scratch.buffers.acquire(rowBytes * channelSize.y);
+		});
+
+		{
+			PhaseTimer timer{m_stats, ImportPhase::Decode, item.layerIndex};
+			const uint8* src = getChannelFileData(*props.file, channel);
+			if (not src || not ChannelDecoder::DecodeRows(
+				src, channel.size, rowBytes, channelSize.y, item.rowBegin, item.rowEnd, data.data()))
+			{
+				job.failed = true;
+			}
+			else if (bytesPerChannel > 1)
+			{
+				// psd_sdk の展開結果と同じくネイティブエンディアンにそろえる
+				uint8* rows = data.data() + rowBytes * item.rowBegin;
+				const size_t count = static_cast<size_t>(channelSize.x) * (item.rowEnd - item.rowBegin);
+				if (bytesPerChannel == 2) Kernel::SwapBytes(reinterpret_cast<uint16*>(rows), count);
+				else Kernel::SwapBytes(reinterpret_cast<uint32*>(rows), count);
+			}
+		}
+		if (m_stats)
+		{
+			// 帯ごとの読み込み量は分からないため、先頭の帯でチャンネル全体を数える
+			if (item.rowBegin == 0) m_stats->bytesRead += channel.size;
+			m_stats->bytesDecompressed += rowBytes * (item.rowEnd - item.rowBegin);
+		}
+
+		// 最後の作業単位を処理したスレッドがレイヤーを仕上げる
+		if (job.pendingItems.fetch_sub(1) != 1) return false;
+
+		if (job.failed)
+		{
+			outputLayer.error = concatError(outputLayer.error, U"Cannot decode channel data.");
+		}
+		else
+		{
+			ChannelDataArray channelData{};
+			for (int c = 0; c < job.channels.colorCount; ++c) channelData[c] = job.channelData[c].data();
+			std::array<MaskPlane, 2> masks{};
+			for (int i = 0; i < job.channels.maskCount; ++i)
+			{
+				const auto& mask = job.channels.masks[i];
+				masks[i] = getMaskPlane(*layer, mask.kind, mask.plane < 0 ? nullptr : job.channelData[mask.plane].data());
+			}
+			storeLayer(
+				item.layerIndex, *layer, channelData, std::span{masks.data(), static_cast<size_t>(job.channels.maskCount)},
+				job, outputLayer);
+			recordScratch(job, outputLayer);
+		}
+
+		for (auto& data : job.channelData) m_scratch.buffers.recycle(std::move(data));
+		job.channelData = {};
+		return true;
+	}
+
+	void LayerImporter::storeLayer(
+		int layerIndex,
+		const Layer& layer,
+		const ChannelDataArray& channelData,
+		std::span<const MaskPlane> masks,
+		const LayerJob& job,
+		PSDLayer& outputLayer) const
+	{
+		Optional<PhaseTimer> timer{std::in_place, m_stats, ImportPhase::Interleave, layerIndex};
+
+		// 既定値が 0 のマスクの外側は透明になるため、書き込む範囲をマスクの範囲に限る
+		Rect visibleRect{getLayerTopLeft(layer), getLayerSize(layer, props.canvasSize)};
+		for (const auto& mask : masks)
+		{
+			if (mask.defaultColor == 0) visibleRect = intersectRect(visibleRect, mask.rect);
+		}
+
+		// レイヤー領域のみを最終的な画像へ直接書き込む
+		const auto imageTl = visibleRect.pos;
+		const auto imageSize = visibleRect.size;
+		const int bytesPerChannel = getBytesPerChannel(props.document);
+		Image image;
+		Color* dest;
+		if (props.config.marginRemove)
+		{
+			outputLayer.region = Rect(imageTl, imageSize);
+			image = Image(imageSize);
+			dest = image.data();
+		}
+		else
+		{
+			outputLayer.region = Rect(props.canvasSize);
+			image = Image(props.canvasSize, Color(0, 0));
+			dest = image.data() + imageTl.y * props.canvasSize.x + imageTl.x;
+		}
+
+		// 帯ごとにインターリーブしてマスクを焼き込み、キャッシュに残っているうちに共有のための行のハッシュを求める
+		// (余白を残す場合は、レイヤー領域の上下の透明な行も含めた画像全体の行を順に数える)
+		const bool hashesRows = props.deduplicator && not (props.bakesClipping && outputLayer.clippingBaseId);
+		const int destY = props.config.marginRemove ? 0 : imageTl.y;
+		uint64 hash = getImageHashSeed(image.size());
+		if (hashesRows) hash = hashRows(image.data(), image.width(), destY, hash);
+		for (int bandY = 0; bandY < imageSize.y; bandY += InterleaveBandRows)
+		{
+			const Point bandTl{imageTl.x, imageTl.y + bandY};
+			const Size bandSize{imageSize.x, Min(InterleaveBandRows, imageSize.y - bandY)};
+			Color* bandDest = dest + bandY * image.width();
+			interleaveLayer(layer, channelData, bandTl, bandSize, bandDest, image.width());
+			for (const auto& mask : masks) bakeMask(mask, bytesPerChannel, bandTl, bandSize, bandDest, image.width());
+			if (hashesRows)
+			{
+				hash = hashRows(image.data() + (destY + bandY) * image.width(), image.width(), bandSize.y, hash);
+			}
+		}
+		if (hashesRows)
+		{
+			const int rowsBelow = image.height() - destY - imageSize.y;
+			hash = hashRows(image.data() + (destY + imageSize.y) * image.width(), image.width(), rowsBelow, hash);
+		}
+
+		// 16/32 ビットの精度を保った画素配列
+		if (props.config.keepFloatImage && bytesPerChannel > 1)
+		{
+			const Size storeSize = outputLayer.region.size;
+			outputLayer.floatImage = Grid<Float4>(storeSize, Float4{});
+			const Point offset = imageTl - outputLayer.region.tl();
+			Float4* floatDest = outputLayer.floatImage.data() + offset.y * storeSize.x + offset.x;
+			interleaveLayer(layer, channelData, imageTl, imageSize, floatDest, storeSize.x);
+			for (const auto& mask : masks) bakeMask(mask, bytesPerChannel, imageTl, imageSize, floatDest, storeSize.x);
+		}
+
+		if (isTrimStore(props.config))
+		{
+			// 切り詰めた場合は格納する画素が変わるため、ハッシュを求め直す
+			const Size untrimmedSize = image.size();
+			trimTransparent(image, outputLayer);
+			if (hashesRows && image.size() != untrimmedSize) hash = hashImage(image);
+		}
+
+		// 格納 (クリッピングされたレイヤーは土台のアルファを焼き込んでから格納する)
+		if (props.bakesClipping && outputLayer.clippingBaseId)
+		{
+			outputLayer.image = std::move(image);
+			return;
+		}
+		const bool keepImage = props.retainImages || job.isClippingBase;
+		if (props.deduplicator)
+		{
+			timer.emplace(m_stats, ImportPhase::Texture, layerIndex);
+			storeDeduplicated(
+				props.config, hash, std::move(image), keepImage, layerIndex, outputLayer, *props.deduplicator);
+			return;
+		}
+		timer.emplace(m_stats, ImportPhase::Texture, layerIndex);
+		storeImage(props.config, image, keepImage, outputLayer);
+	}
+}
+
+struct PSDImporter::Impl
+{
+	Config m_config{};
+	PSDError m_error{};
+	/// @brief 読み込み結果 (getObjectShared() で共有されるため、再読み込み時は新しいオブジェクトに差し替える)
+	std::shared_ptr<PSDObject> m_object = std::make_shared<PSDObject>();
+	std::atomic<bool> m_ready{};
+	std::unique_ptr<std::atomic<bool>[]> m_layerReady{};
+	std::atomic<int32> m_completedLayers{};
+	std::atomic<int32> m_totalLayers{};
+	std::atomic<size_t> m_nextWorkItem{};
+
+	/// @brief 読み込みを実行するワーカー
+	std::shared_ptr<PSDWorkerPool> m_pool{};
+
+	/// @brief 読み込みが終わったか (作業単位をすべて処理し、ドキュメントを閉じるか遅延展開に備えるまで)
+	std::mutex m_finishedMutex{};
+	std::condition_variable m_finishedChanged{};
+	bool m_finished = true;
+
+	/// @brief ドキュメントとレイヤー情報の確保先 (ドキュメントを閉じる際にまとめて解放する)
+	ArenaAllocator m_allocator{64 * 1024};
+	std::unique_ptr<MappedFile> m_file{};
+	Document* m_document{};
+	LayerMaskSection* m_layerMaskSection{};
+
+	/// @brief 画素を持つレイヤーの R, G, B, A チャンネル番号
+	Array<Optional<LayerChannels>> m_layerChannels{};
+
+	std::mutex m_cacheMutex{};
+	DecodedLayerCache m_layerCache{};
+
+	/// @brief 画素が同じレイヤーとテクスチャを共有するための表
+	LayerDeduplicator m_deduplicator{};
+
+	/// @brief 画素を持つレイヤーの圧縮されたチャンネルデータのハッシュ
+	Array<uint64> m_contentHashes{};
+
+	/// @brief キャッシュファイルの検証に使う元ファイルの情報
+	Optional<CacheFile::SourceKey> m_cacheKey{};
+
+	/// @brief 全レイヤーの展開後の処理が終わるまでレイヤーを完了扱いにしないか
+	bool m_deferCompletion{};
+
+	/// @brief 全レイヤーの展開後にクリッピングを焼き込むか
+	bool m_bakesClipping{};
+
+	/// @brief 画素を持つレイヤーの指紋
+	Array<uint64> m_fingerprints{};
+
+	/// @brief 再読み込み時、前回の読み込み結果と指紋からレイヤー番号への対応
+	std::shared_ptr<const PSDObject> m_previousObject{};
+	std::unordered_map<uint64, int> m_previousLayers{};
+
+	/// @brief 統合画像のプレビュー
+	Image m_previewImage{};
+	DynamicTexture m_previewTexture{};
+	std::atomic<bool> m_previewReady{};
+
+	/// @brief 展開中のレイヤーと作業単位
+	Array<LayerJob> m_jobs{};
+	Array<WorkItem> m_workItems{};
+	Array<int> m_pixelLayers{};
+
+	/// @brief ワーカーで読み込むための実行環境 (PSDBatchImporter から読み込む場合は結果の受け取り先を含む)
+	std::unique_ptr<ImportScheduler> m_scheduler{};
+
+	/// @brief ワーカーで処理中のタスク数
+	std::atomic<int> m_pendingTasks{};
+
+	/// @brief 共有のメモリ上限から確保したバイト数
+	size_t m_reservedBytes{};
+
+	/// @brief 読み込みの計測 (collectStats が false の場合は nullptr)
+	std::unique_ptr<ImportStatsRecorder> m_stats{};
+	ImportStatsRecorder::ThreadRecord* m_mainStats{};
+	ImportStats m_importStats{};
+
+	DirectoryWatcher m_watcher{};
+	FilePath m_watchedPath{};
+	Stopwatch m_changeStopwatch{};
+	bool m_changePending{};
+
+	~Impl()
+	{
+		waitFinished();
+		closeDocument();
+	}
+
+	/// @brief 読み込みに使うワーカーを決める
+	void usePool(std::shared_ptr<PSDWorkerPool> pool)
+	{
+		m_pool = pool ? std::move(pool) : PSDWorkerPool::Global();
+		m_scheduler = std::make_unique<ImportScheduler>();
+		m_scheduler->pool = &m_pool->workers();
+	}
+
+	void import()
+	{
+		m_layerCache.setCapacity(m_config.decodedCacheBytes);
+		m_finished = false;
+
+		if (m_config.asyncStart)
+		{
+			m_scheduler->pool->submit([this]()
+			{
+				importInternal();
+			});
+		}
+		else
+		{
+			// レイヤーの展開はワーカーで続くため、終わるまで待つ
+			importInternal();
+			waitFinished();
+		}
+	}
+
+	void waitFinished()
+	{
+		std::unique_lock lock{m_finishedMutex};
+		m_finishedChanged.wait(lock, [&]() { return m_finished; });
+	}
+
+	bool isFinished()
+	{
+		std::lock_guard lock{m_finishedMutex};
+		return m_finished;
+	}
+
+	void notifyFinished()
+	{
+		// 待っている側が Impl を破棄できるのは、ロックを離した後
+		std::lock_guard lock{m_finishedMutex};
+		m_finished = true;
+		m_finishedChanged.notify_all();
+	}
+
+	bool isLayerReady(PSDLayer::id_type id) const noexcept
+	{
+		return 0 <= id && id < m_totalLayers.load(std::memory_order_acquire)
+			&& m_layerReady[id].load(std::memory_order_acquire);
+	}
+
+	Optional<PSDLayer> getDecodedLayer(PSDLayer::id_type id)
+	{
+		if (not isLayerReady(id)) return none;
+		if (not m_config.lazyDecode) return m_object->layers[id];
+
+		std::lock_guard lock{m_cacheMutex};
+		if (const PSDLayer* cached = m_layerCache.find(id)) return *cached;
+
+		const PSDLayer layer = decodeLayer(id);
+		m_layerCache.insert(id, layer, m_config.storeTarget);
+		return layer;
+	}
+
+	PSDObject takeObject()
+	{
+		if (not m_ready) return PSDObject{};
+
+		// 取り出した後はレイヤーを持たない (再読み込み時に使い回す前回の結果も無くなる)
+		m_totalLayers.store(0, std::memory_order_release);
+		m_completedLayers.store(0, std::memory_order_release);
+		m_fingerprints.clear();
+		m_previousLayers.clear();
+		{
+			std::lock_guard lock{m_cacheMutex};
+			m_layerCache.clear();
+		}
+
+		// 共有中のオブジェクトは他から参照されているため複製する
+		if (m_object.use_count() > 1)
+		{
+			PSDObject object = *m_object;
+			m_object = std::make_shared<PSDObject>();
+			return object;
+		}
+		PSDObject object = std::move(*m_object);
+		*m_object = PSDObject{};
+		return object;
+	}
+
+	size_t getCachedBytes()
+	{
+		std::lock_guard lock{m_cacheMutex};
+		return m_layerCache.usedBytes();
+	}
+
+	void watch()
+	{
+		m_watchedPath = FileSystem::FullPath(m_config.filepath);
+		m_watcher = DirectoryWatcher{FileSystem::ParentPath(m_watchedPath)};
+	}
+
+	void reload()
+	{
+		waitFinished();
+		closeDocument();
+
+		// 前回の結果を指紋で引けるようにしておく
+		m_previousObject = std::move(m_object);
+		m_object = std::make_shared<PSDObject>();
+		m_previousLayers.clear();
+		for (size_t i = 0; i < m_fingerprints.size(); ++i)
+		{
+			if (m_fingerprints[i] != 0) m_previousLayers.emplace(m_fingerprints[i], static_cast<int>(i));
+		}
+
+		m_totalLayers.store(0, std::memory_order_release);
+		m_completedLayers.store(0, std::memory_order_release);
+		m_ready = false;
+		m_previewReady = false;
+		m_error = PSDError{};
+		m_layerChannels.clear();
+		m_fingerprints.clear();
+		m_contentHashes.clear();
+		m_deduplicator.reset();
+		m_jobs.clear();
+		m_workItems.clear();
+		m_pixelLayers.clear();
+		m_nextWorkItem = 0;
+		m_cacheKey.reset();
+		m_deferCompletion = false;
+		m_bakesClipping = false;
+		m_stats.reset();
+		m_mainStats = nullptr;
+		m_importStats = ImportStats{};
+		{
+			std::lock_guard lock{m_cacheMutex};
+			m_layerCache.clear();
+		}
+
+		import();
+	}
+
+	bool update()
+	{
+		if (not m_config.watchFile) return false;
+
+		for (const auto& change : m_watcher.retrieveChanges())
+		{
+			if (FileSystem::FullPath(change.path) != m_watchedPath) continue;
+			if (change.action == FileAction::Added
+				|| change.action == FileAction::Modified
+				|| change.action == FileAction::RenamedNewName)
+			{
+				m_changeStopwatch.restart();
+				m_changePending = true;
+			}
+		}
+
+		// 保存中の書き込みが落ち着くまで待つ
+		constexpr int64 reloadDelayMs = 200;
+		if (not m_changePending || m_changeStopwatch.ms() < reloadDelayMs) return false;
+		if (not isFinished()) return false;
+
+		m_changePending = false;
+		reload();
+		return true;
+	}
+
+private:
+	void importInternal()
+	{
+		if (m_config.collectStats)
+		{
+			m_stats = std::make_unique<ImportStatsRecorder>(m_config.collectTrace);
+			m_mainStats = &m_stats->beginThread();
+		}
+
+		if (m_scheduler && m_scheduler->isCancelled())
+		{
+			m_error = PSDError(U"Cancelled.");
+			endImport();
+			return;
+		}
+
+		if (m_config.previewOnly)
+		{
+			// レイヤーのデータには触れない
+			if (openDocument() && decodePreview()) markReady();
+			endImport();
+			return;
+		}
+
+		if (isCacheFileStore(m_config))
+		{
+			m_cacheKey = CacheFile::MakeSourceKey(
+				m_config.filepath, CacheFile::GetCacheFilePath(m_config.filepath, m_config.cacheDirectory),
+				m_config.marginRemove, getBakedMaskFlags(m_config), m_config.dither);
+			if (m_cacheKey && loadCacheFile())
+			{
+				markReady();
+				endImport();
+				return;
+			}
+		}
+
+		if (not openDocument())
+		{
+			endImport();
+			return;
+		}
+
+		// 統合画像を先に見せ、レイヤーの読み込みを続ける
+		if (m_config.decodePreview) (void)decodePreview();
+
+		if (not openLayers())
+		{
+			endImport();
+			return;
+		}
+
+		if (m_config.lazyDecode)
+		{
+			// メタ情報のみ読み込み、画素は要求されたときに展開する
+			readLayerInfos();
+			markReady();
+			notifyFinished();
+			return;
+		}
+
+		// 最後の作業単位を処理したワーカーが読み込みを終える
+		extractLayers();
+	}
+
+	/// @brief ドキュメントを閉じ、PSDBatchImporter から読み込んでいる場合は結果を渡す
+	void endImport()
+	{
+		closeDocument();
+		if (m_scheduler->onFinished)
+		{
+			// テクスチャのみを格納する場合、画素は既に解放されている
+			size_t heldBytes = m_reservedBytes;
+			if (m_scheduler->memoryBudget && not isImageStore(m_config.storeTarget))
+			{
+				m_scheduler->memoryBudget->release(m_reservedBytes);
+				heldBytes = 0;
+			}
+
+			m_scheduler->onFinished(
+				std::move(*m_object),
+				m_ready ? none : Optional<PSDError>{m_error},
+				std::move(m_importStats),
+				heldBytes);
+		}
+		notifyFinished();
+	}
+
+	bool openDocument()
+	{
+		PhaseTimer timer{m_mainStats, ImportPhase::Open};
+		const std::wstring srcPath = Unicode::ToWstring(m_config.filepath);
+
+		// 各スレッドがロックなしで読み込めるようにメモリマップする
+		m_file = std::make_unique<MappedFile>(&m_allocator);
+
+		if (not m_file->OpenRead(srcPath.c_str()))
+		{
+			m_error = PSDError(U"Cannot open file.");
+			return false;
+		}
+
+		m_document = CreateDocument(m_file.get(), &m_allocator);
+		if (not m_document)
+		{
+			m_error = PSDError(U"Cannot create document.");
+			return false;
+		}
+		if (getColorChannelTypes(m_document->colorMode).empty())
+		{
+			m_error = PSDError(U"Color mode is not supported.");
+			return false;
+		}
+
+		// 画素を展開する前にビット深度を確認する
+		if (not isSupportedBitsPerChannel(m_document->bitsPerChannel))
+		{
+			m_error = PSDError(U"{}-bit / channel is not supported."_fmt(m_document->bitsPerChannel));
+			return false;
+		}
+		if (m_document->colorMode != colorMode::RGB && m_document->bitsPerChannel != 8)
+		{
+			m_error = PSDError(U"{}-bit / channel is supported only in RGB color mode."_fmt(m_document->bitsPerChannel));
+			return false;
+		}
+
+		m_object->documentSize = {m_document->width, m_document->height};
+		return true;
+	}
+
+	bool openLayers()
+	{
+		PhaseTimer timer{m_mainStats, ImportPhase::Open};
+		// レイヤー情報抽出
+		m_layerMaskSection = ParseLayerMaskSection(m_document, m_file.get(), &m_allocator);
+		if (not m_layerMaskSection)
+		{
+			m_error = PSDError(U"Layers and masks are missing.");
+			return false;
+		}
+
+		return true;
+	}
+
+	bool decodePreview()
+	{
+		PhaseTimer timer{m_mainStats, ImportPhase::Preview};
+		auto image = decodeMergedImage(*m_file, *m_document, m_config, *m_scheduler->pool);
+		if (not image)
+		{
+			if (m_config.previewOnly) m_error = PSDError(U"Merged image is missing.");
+			return false;
+		}
+
+		if (isTextureStore(m_config.storeTarget))
+		{
+			m_previewTexture = DynamicTexture(*image, getTextureDesc(m_config.storeTarget));
+		}
+		m_previewImage = std::move(*image);
+		m_previewReady.store(true, std::memory_order_release);
+		return true;
+	}
+
+	void closeDocument()
+	{
+		if (m_layerMaskSection) DestroyLayerMaskSection(m_layerMaskSection, &m_allocator);
+		if (m_document) DestroyDocument(m_document, &m_allocator);
+		m_layerMaskSection = nullptr;
+		m_document = nullptr;
+		m_file.reset();
+		m_allocator.release();
+	}
+
+	LayerImporter::Props getLayerImporterProps()
+	{
+		return {
+			.config = m_config,
+			.file = m_file.get(),
+			.document = m_document,
+			.layerMaskSection = m_layerMaskSection,
+			.canvasSize = m_object->documentSize,
+			.retainImages = m_cacheKey.has_value(),
+			.bakesClipping = m_bakesClipping,
+			.deduplicator = isDedupStore(m_config) ? &m_deduplicator : nullptr,
+		};
+	}
+
+	/// @brief すべてのレイヤーのメタ情報を読み込み、画素を持つレイヤーのチャンネル番号を記録
+	void readLayerInfos()
+	{
+		PhaseTimer timer{m_mainStats, ImportPhase::Open};
+		const int layerCount = m_layerMaskSection->layerCount;
+		m_object->layers.resize(layerCount);
+		m_layerChannels.resize(layerCount);
+		m_fingerprints.resize(layerCount);
+		m_contentHashes.resize(layerCount);
+		m_layerReady = std::make_unique<std::atomic<bool>[]>(layerCount);
+		m_totalLayers.store(layerCount, std::memory_order_release);
+
+		for (int index = 0; index < layerCount; ++index)
+		{
+			m_layerChannels[index] = readLayerInfo(
+				m_config, m_document, m_layerMaskSection, index, m_object->layers[index]);
+			if (const auto base = findClippingBase(*m_layerMaskSection, index);
+				base && m_layerChannels[*base] && m_layerChannels[index])
+			{
+				m_object->layers[index].clippingBaseId = *base;
+			}
+			if (m_layerChannels[index] && not m_config.lazyDecode)
+			{
+				const Layer& layer = m_layerMaskSection->layers[index];
+				m_contentHashes[index] = getLayerContentHash(*m_file, layer, *m_layerChannels[index]);
+				m_fingerprints[index] = getLayerFingerprint(
+					m_contentHashes[index], layer, m_object->layers[index], m_object->documentSize);
+			}
+
+			// 遅延展開時と画素を持たないレイヤーはメタ情報のみで完成
+			if (m_config.lazyDecode || not m_layerChannels[index]) completeLayer(index);
+		}
+	}
+
+	/// @brief 元ファイルに対応するキャッシュファイルがあれば、展開せずに画素を読み込む
+	bool loadCacheFile()
+	{
+		// キャッシュファイルからの読み込みは展開として計測する
+		PhaseTimer timer{m_mainStats, ImportPhase::Decode};
+		CacheFile::Reader reader{};
+		if (not reader.open(CacheFile::GetCacheFilePath(m_config.filepath, m_config.cacheDirectory), *m_cacheKey))
+		{
+			return false;
+		}
+
+		m_deferCompletion = isAtlasStore(m_config);
+		*m_object = reader.object();
+		const int layerCount = static_cast<int>(m_object->layers.size());
+		m_layerReady = std::make_unique<std::atomic<bool>[]>(layerCount);
+		m_totalLayers.store(layerCount, std::memory_order_release);
+
+		Array<int> pixelLayers{};
+		Array<int> sharedLayers{};
+		for (int index = 0; index < layerCount; ++index)
+		{
+			auto& layer = m_object->layers[index];
+			if (not isDedupStore(m_config)) layer.sharedTextureId.reset();
+
+			// 共有元が同じ画素を持っていなければ共有しない
+			if (layer.sharedTextureId
+				&& (not reader.pixels(*layer.sharedTextureId) || m_object->layers[*layer.sharedTextureId].sharedTextureId
+					|| reader.imageSize(*layer.sharedTextureId) != reader.imageSize(index)))
+			{
+				layer.sharedTextureId.reset();
+			}
+
+			if (not reader.pixels(index)) completeLayer(index);
+			else if (layer.sharedTextureId && not isAtlasStore(m_config)) sharedLayers.push_back(index);
+			else pixelLayers.push_back(index);
+		}
+
+		const auto loadImage = [&](int index)
+		{
+			Image image(reader.imageSize(index));
+			std::memcpy(image.data(), reader.pixels(index), image.size_bytes());
+			return image;
+		};
+
+		// マップされた画素を複製してそのまま格納する
+		m_scheduler->pool->parallelFor(pixelLayers.size(), m_config.maxThreads, [&](size_t i)
+		{
+			const int index = pixelLayers[i];
+			const Image image = loadImage(index);
+			storeImage(m_config, image, false, m_object->layers[index]);
+			if (isAtlasStore(m_config) && m_object->layers[index].sharedTextureId)
+			{
+				m_deduplicator.recordShared(getSharedTextureBytes(m_config, image));
+			}
+			if (not m_deferCompletion) completeLayer(index);
+		});
+
+		// 書き出し時にテクスチャを共有していたレイヤーは、共有元のテクスチャを使い回す (アトラスは packAtlas で共有する)
+		for (const int index : sharedLayers)
+		{
+			auto& layer = m_object->layers[index];
+			const Image image = loadImage(index);
+			storeImage(m_config, image, false, layer, &m_object->layers[*layer.sharedTextureId].texture);
+			m_deduplicator.recordShared(getSharedTextureBytes(m_config, image));
+			if (not m_deferCompletion) completeLayer(index);
+		}
+		pixelLayers.append(sharedLayers);
+
+		finishPixelLayers(pixelLayers);
+		return true;
+	}
+
+	/// @brief 画素を持つレイヤーの展開を準備し、作業単位を並べる
+	void prepareLayerJobs()
+	{
+		// メタ情報を先に読み込み、画素を持つレイヤーの処理コストを見積もる
+		readLayerInfos();
+		m_bakesClipping = m_config.bakeClipping && std::ranges::any_of(
+			m_object->layers, [](const PSDLayer& layer) { return layer.clippingBaseId.has_value(); });
+		m_deferCompletion = isAtlasStore(m_config) || (m_cacheKey && not isImageStore(m_config.storeTarget));
+
+		const int layerCount = m_layerMaskSection->layerCount;
+		m_jobs = Array<LayerJob>(layerCount);
+		if (m_bakesClipping)
+		{
+			for (const auto& layer : m_object->layers)
+			{
+				if (layer.clippingBaseId) m_jobs[*layer.clippingBaseId].isClippingBase = true;
+			}
+		}
+		m_pixelLayers.clear();
+		for (int index = 0; index < layerCount; ++index)
+		{
+			if (not m_layerChannels[index]) continue;
+			if (reusePreviousLayer(index))
+			{
+				completeLayer(index);
+				continue;
+			}
+			prepareLayerJob(
+				*m_file, m_layerMaskSection->layers[index], *m_layerChannels[index], getBytesPerChannel(m_document),
+				m_jobs[index]);
+			m_pixelLayers.push_back(index);
+		}
+
+		m_workItems = scheduleWorkItems(m_config, *m_layerMaskSection, m_jobs, m_pixelLayers);
+		if (m_stats) m_stats->setCompressedBytes(m_jobs.map([](const LayerJob& job) { return job.compressedBytes; }));
+	}
+
+	/// @brief 必要なメモリを確保できたらワーカーに作業単位を投入し、最後に終わったワーカーが仕上げる
+	void extractLayers()
+	{
+		prepareLayerJobs();
+
+		// maxThreads 個までのワーカーがそれぞれ作業単位を取り出して処理する
+		const int taskCount = std::min({
+			m_config.maxThreads, m_scheduler->pool->threadCount(), static_cast<int>(m_workItems.size())
+		});
+		if (taskCount == 0)
+		{
+			finishLayerJobs();
+			endImport();
+			return;
+		}
+
+		m_reservedBytes = m_scheduler->memoryBudget ? estimateExtractionBytes() : 0;
+		const auto submitTasks = [this, taskCount]()
+		{
+			m_pendingTasks = taskCount;
+			for (int id = 0; id < taskCount; ++id)
+			{
+				m_scheduler->pool->submit([this, id]()
+				{
+					extractLayersAsync(id);
+					if (m_pendingTasks.fetch_sub(1) != 1) return;
+
+					if (m_scheduler->isCancelled()) m_error = PSDError(U"Cancelled.");
+					else finishLayerJobs();
+					endImport();
+				});
+			}
+		};
+
+		if (m_scheduler->memoryBudget) m_scheduler->memoryBudget->acquire(m_reservedBytes, submitTasks);
+		else submitTasks();
+	}
+
+	/// @brief 展開中の作業用メモリと格納する画素のバイト数の上限を見積もる
+	size_t estimateExtractionBytes() const
+	{
+		const bool keepsFloat = m_config.keepFloatImage && getBytesPerChannel(m_document) > 1;
+		const size_t pixelBytes = sizeof(Color) + (keepsFloat ? sizeof(Float4) : 0);
+		size_t bytes = 0;
+		for (const int index : m_pixelLayers)
+		{
+			const Size imageSize = m_config.marginRemove
+				                       ? getLayerSize(m_layerMaskSection->layers[index], m_object->documentSize)
+				                       : m_object->documentSize;
+			bytes += m_jobs[index].decodedBytes + static_cast<size_t>(imageSize.x) * imageSize.y * pixelBytes;
+		}
+		return bytes;
+	}
+
+	/// @brief 全レイヤーの展開後の処理を行い、読み込みを完了させる
+	void finishLayerJobs()
+	{
+		{
+			PhaseTimer timer{m_mainStats, ImportPhase::Finish};
+			if (m_bakesClipping) bakeClippingLayers(m_pixelLayers);
+
+			if (m_cacheKey)
+			{
+				// 書き出せなくても読み込み結果はそのまま使う (次回は元ファイルから読み込む)
+				const FilePath cachePath = CacheFile::GetCacheFilePath(m_config.filepath, m_config.cacheDirectory);
+				if (not CacheFile::Write(cachePath, *m_cacheKey, *m_object))
+				{
+					Logger << U"[SivPSD] Cannot write cache file: {}"_fmt(cachePath);
+				}
+			}
+
+			finishPixelLayers(m_pixelLayers);
+			m_deduplicator.clear();
+		}
+		m_jobs.clear();
+		m_workItems.clear();
+		m_pixelLayers.clear();
+		m_previousObject.reset();
+		m_previousLayers.clear();
+		markReady();
+	}
+
+	/// @brief 計測結果をまとめてから読み込みを完了させる
+	void markReady()
+	{
+		if (m_stats)
+		{
+			m_stats->endThread(*m_mainStats);
+			m_importStats = m_stats->build(*m_object, m_config.statsSlowestLayers);
+		}
+		m_ready = true;
+	}
+
+	/// @brief 再読み込み時、指紋が一致する前回のレイヤーの画像とテクスチャを使い回す
+	bool reusePreviousLayer(int index)
+	{
+		// アトラスやキャッシュファイルへの書き出しは全レイヤーの画像を必要とする
+		if (m_deferCompletion) return false;
+
+		// 土台が変わっている可能性があるため、クリッピングは焼き込み直す (土台も焼き込みに画像が要るため展開し直す)
+		if (m_bakesClipping && (m_object->layers[index].clippingBaseId || m_jobs[index].isClippingBase)) return false;
+
+		const auto it = m_previousLayers.find(m_fingerprints[index]);
+		if (it == m_previousLayers.end() || not m_previousObject
+			|| static_cast<size_t>(it->second) >= m_previousObject->layers.size())
+		{
+			return false;
+		}
+
+		const PSDLayer& previous = m_previousObject->layers[it->second];
+		if (previous.image.isEmpty() && previous.compressedImage.isEmpty() && previous.texture.isEmpty()
+			&& not previous.isBlank)
+		{
+			return false;
+		}
+
+		auto& layer = m_object->layers[index];
+		layer.region = previous.region;
+		layer.isBlank = previous.isBlank;
+		layer.image = previous.image;
+		layer.compressedImage = previous.compressedImage;
+		layer.floatImage = previous.floatImage;
+		layer.texture = previous.texture;
+		return true;
+	}
+
+	/// @brief 全レイヤーの展開後の処理を行い、保留していたレイヤーを完了させる
+	void finishPixelLayers(const Array<int>& pixelLayers)
+	{
+		if (isAtlasStore(m_config))
+		{
+			packAtlas(pixelLayers);
+		}
+		else if (m_deferCompletion)
+		{
+			// キャッシュファイルへの書き出し用に保持していた画像を破棄
+			for (const int index : pixelLayers) m_object->layers[index].image = Image{};
+		}
+
+		for (const int index : pixelLayers)
+		{
+			if (isCompletionDeferred(index)) completeLayer(index);
+		}
+	}
+
+	/// @brief 全レイヤーの展開後までレイヤーを完了扱いにしないか
+	bool isCompletionDeferred(int index) const
+	{
+		// 土台は焼き込み後に画像を破棄するため、それまで完了扱いにしない
+		return m_deferCompletion
+			|| (m_bakesClipping && (m_object->layers[index].clippingBaseId || m_jobs[index].isClippingBase));
+	}
+
+	/// @brief クリッピングされたレイヤーに土台のアルファを焼き込んでから格納する
+	void bakeClippingLayers(const Array<int>& pixelLayers)
+	{
+		const Array<int> clippedLayers = pixelLayers.filter([&](int index)
+		{
+			return m_object->layers[index].clippingBaseId.has_value();
+		});
+
+		// 土台はクリッピングされていないため、レイヤーごとに並列で焼き込める
+		m_scheduler->pool->parallelFor(clippedLayers.size(), m_config.maxThreads, [&](size_t i)
+		{
+			auto& layer = m_object->layers[clippedLayers[i]];
+			bakeClipping(m_object->layers[*layer.clippingBaseId], m_config, layer);
+			Image image = std::move(layer.image);
+			layer.image = Image{};
+			if (isDedupStore(m_config))
+			{
+				// 焼き込みで画素が変わるため、クリッピングされたレイヤーのみ焼き込み後にハッシュを求める
+				const uint64 hash = hashImage(image);
+				storeDeduplicated(
+					m_config, hash, std::move(image), m_cacheKey.has_value(), clippedLayers[i], layer, m_deduplicator);
+			}
+			else
+			{
+				storeImage(m_config, image, m_cacheKey.has_value(), layer);
+			}
+		});
+
+		// 焼き込みのためだけに保持していた土台の画像を破棄
+		if (not m_deferCompletion && not isImageStore(m_config.storeTarget))
+		{
+			for (const int index : pixelLayers)
+			{
+				if (m_jobs[index].isClippingBase) m_object->layers[index].image = Image{};
+			}
+		}
+	}
+
+	/// @brief 展開済みレイヤーの画像をアトラスページに詰め込み、ページごとに並列でテクスチャを作る
+	void packAtlas(const Array<int>& pixelLayers)
+	{
+		Array<Size> sizes{};
+		for (const int index : pixelLayers)
+		{
+			// テクスチャを共有するレイヤーは元のレイヤーの領域を使うため、詰め込まない
+			const auto& layer = m_object->layers[index];
+			sizes.push_back(layer.sharedTextureId ? Size{} : layer.image.size());
+		}
+
+		AtlasPacker packer{m_config.atlasPageSize, m_config.atlasPadding};
+		const auto placements = packer.pack(sizes);
+
+		// ページごとに、詰め込まれた pixelLayers の要素番号をまとめる
+		Array<Array<size_t>> pageItems(packer.pageCount());
+		for (size_t i = 0; i < pixelLayers.size(); ++i)
+		{
+			auto& layer = m_object->layers[pixelLayers[i]];
+			if (placements[i])
+			{
+				pageItems[placements[i]->page].push_back(i);
+			}
+			else if (not layer.image.isEmpty() && not layer.sharedTextureId)
+			{
+				// ページに収まらない
+				layer.texture = DynamicTexture(layer.image, TextureDesc::Unmipped);
+			}
+		}
+
+		const auto packPage = [&](int32 page)
+		{
+			Image pageImage(packer.usedSize(page), Color(0, 0));
+			for (const size_t i : pageItems[page])
+			{
+				(void)m_object->layers[pixelLayers[i]].image.overwrite(pageImage, placements[i]->pos);
+			}
+			m_object->atlasPages[page] = DynamicTexture(pageImage, TextureDesc::Unmipped);
+
+			for (const size_t i : pageItems[page])
+			{
+				auto& layer = m_object->layers[pixelLayers[i]];
+				layer.atlasRegion = m_object->atlasPages[page](Rect(placements[i]->pos, layer.image.size()));
+			}
+		};
+
+		m_object->atlasPages.resize(packer.pageCount());
+		m_scheduler->pool->parallelFor(packer.pageCount(), m_config.maxThreads, [&](size_t page)
+		{
+			packPage(static_cast<int32>(page));
+		});
+
+		// 画素が同じレイヤーは元のレイヤーの領域 (ページに収まらない場合はテクスチャ) を共有する
+		for (const int index : pixelLayers)
+		{
+			auto& layer = m_object->layers[index];
+			if (not layer.sharedTextureId) continue;
+			const auto& source = m_object->layers[*layer.sharedTextureId];
+			layer.atlasRegion = source.atlasRegion;
+			layer.texture = source.texture;
+		}
+
+		if (m_config.storeTarget == StoreTarget::AtlasTexture)
+		{
+			for (const int index : pixelLayers) m_object->layers[index].image = Image{};
+		}
+	}
+
+	void extractLayersAsync(int threadId)
+	{
+		// Stopwatch sw{};
+		// sw.start();
+		// Console.writeln(U"Thread {} start"_fmt(threadId));
+		ImportStatsRecorder::ThreadRecord* stats = m_stats ? &m_stats->beginThread() : nullptr;
+		LayerImporter layerReader{getLayerImporterProps(), stats};
+
+		while (true)
+		{
+			if (m_scheduler && m_scheduler->isCancelled()) break;
+
+			const size_t nextIndex = m_nextWorkItem.fetch_add(1);
+			if (nextIndex >= m_workItems.size()) break;
+			const auto& item = m_workItems[nextIndex];
+			if (layerReader.processWorkItem(item, m_jobs[item.layerIndex], m_object->layers[item.layerIndex])
+				&& not isCompletionDeferred(item.layerIndex))
+			{
+				completeLayer(item.layerIndex);
+			}
+		}
+		if (stats) m_stats->endThread(*stats);
+		// Console.writeln(U"Thread {}: {}"_fmt(threadId, sw.sF()));
+	}
+
+	/// @brief 遅延展開時、呼び出し元のスレッドで1レイヤーを展開
+	PSDLayer decodeLayer(int index)
+	{
+		PSDLayer outputLayer = m_object->layers[index];
+		if (not m_layerChannels[index]) return outputLayer;
+
+		const Layer& layer = m_layerMaskSection->layers[index];
+		LayerJob job{};
+		prepareLayerJob(*m_file, layer, *m_layerChannels[index], getBytesPerChannel(m_document), job);
+
+		LayerImporter layerReader{getLayerImporterProps()};
+		if (job.splitChannels)
+		{
+			job.pendingItems = job.channels.count;
+			for (int channel = 0; channel < job.channels.count; ++channel)
+			{
+				layerReader.processWorkItem({index, channel, 0, job.planeSizes[channel].y}, job, outputLayer);
+			}
+		}
+		else
+		{
+			job.pendingItems = 1;
+			layerReader.processWorkItem({index, none, 0, job.planeSizes[0].y}, job, outputLayer);
+		}
+		return outputLayer;
+	}
+
+	void completeLayer(int index)
+	{
+		m_layerReady[index].store(true, std::memory_order_release);
+		m_completedLayers.fetch_add(1, std::memory_order_release);
+		if (m_config.onLayerReady) m_config.onLayerReady(m_object->layers[index]);
+	}
+};
+
+namespace SivPSD
+{
+	PSDImporter::PSDImporter() : PSDImporter(Config())
+	{
+	}
+
+	PSDImporter::PSDImporter(const FilePath& filepath) : PSDImporter(Config{
+		.filepath = filepath
+	})
+	{
+	}
+
+	PSDImporter::PSDImporter(const Config& config) :
+		p_impl(std::make_shared<Impl>())
+	{
+		p_impl->m_config = config;
+		p_impl->usePool(config.workerPool);
+		if (config.watchFile) p_impl->watch();
+		p_impl->import();
+	}
+
+	PSDImporter::PSDImporter(const Config& config, std::unique_ptr<ImportScheduler> scheduler) :
+		p_impl(std::make_shared<Impl>())
+	{
+		p_impl->m_config = config;
+		p_impl->m_scheduler = std::move(scheduler);
+		p_impl->import();
+	}
+
+	Optional<PSDError> PSDImporter::getCriticalError() const
+	{
+		return p_impl->m_ready || p_impl->m_error.what().empty()
+			       ? none
+			       : Optional<PSDError>(p_impl->m_error);
+	}
+
+	PSDObject PSDImporter::getObject() const
+	{
+		return p_impl->m_ready
+			       ? *p_impl->m_object
+			       : PSDObject{};
+	}
+
+	const PSDObject& PSDImporter::getObjectRef() const
+	{
+		static const PSDObject empty{};
+		return p_impl->m_ready
+			       ? *p_impl->m_object
+			       : empty;
+	}
+
+	std::shared_ptr<const PSDObject> PSDImporter::getObjectShared() const
+	{
+		return p_impl->m_ready
+			       ? std::shared_ptr<const PSDObject>{p_impl->m_object}
+			       : std::make_shared<const PSDObject>();
+	}
+
+	PSDObject PSDImporter::takeObject()
+	{
+		return p_impl->takeObject();
+	}
+
+	bool PSDImporter::isReady() const noexcept
+	{
+		return p_impl->m_ready;
+	}
+
+	bool PSDImporter::isLayerReady(PSDLayer::id_type id) const noexcept
+	{
+		return p_impl->isLayerReady(id);
+	}
+
+	Optional<PSDLayer> PSDImporter::getLayer(PSDLayer::id_type id) const
+	{
+		return p_impl->isLayerReady(id)
+			       ? Optional<PSDLayer>(p_impl->m_object->layers[id])
+			       : none;
+	}
+
+	Optional<PSDLayer> PSDImporter::getDecodedLayer(PSDLayer::id_type id) const
+	{
+		return p_impl->getDecodedLayer(id);
+	}
+
+	bool PSDImporter::isPreviewReady() const noexcept
+	{
+		return p_impl->m_previewReady.load(std::memory_order_acquire);
+	}
+
+	Image PSDImporter::getPreviewImage() const
+	{
+		return isPreviewReady() ? p_impl->m_previewImage : Image{};
+	}
+
+	DynamicTexture PSDImporter::getPreviewTexture() const
+	{
+		return isPreviewReady() ? p_impl->m_previewTexture : DynamicTexture{};
+	}
+
+	ImportStats PSDImporter::getImportStats() const
+	{
+		return p_impl->m_ready ? p_impl->m_importStats : ImportStats{};
+	}
+
+	PSDImporter::DedupStats PSDImporter::getDedupStats() const
+	{
+		return p_impl->m_ready ? p_impl->m_deduplicator.stats() : DedupStats{};
+	}
+
+	size_t PSDImporter::getCachedBytes() const
+	{
+		return p_impl->getCachedBytes();
+	}
+
+	void PSDImporter::reload()
+	{
+		p_impl->reload();
+	}
+
+	bool PSDImporter::update()
+	{
+		return p_impl->update();
+	}
+
+	PSDImporter::Progress PSDImporter::getProgress() const noexcept
+	{
+		return {
+			.completed = p_impl->m_completedLayers.load(std::memory_order_acquire),
+			.total = p_impl->m_totalLayers.load(std::memory_order_acquire),
+		};
+	}
+
+	double PSDImporter::Progress::rate() const noexcept
+	{
+		return total == 0 ? 0.0 : static_cast<double>(completed) / total;
 	}
 }
@@ -1,8 +1,12 @@
 ﻿#pragma once
+#include "PSDImportStats.h"
 #include "PSDObject.h"
+#include "PSDWorkerPool.h"
 
 namespace SivPSD
 {
+	struct ImportScheduler;
+
 	/// @brief 読み込み情報の格納先
 	enum class StoreTarget
 	{
@@ -11,6 +15,11 @@ namespace SivPSD
 		MipmapTexture,
 		ImageAndTexture,
 		ImageAndMipmapTexture,
+		/// @brief 全レイヤーを少数のアトラスページに詰め込み、各レイヤーはページ内の領域を持つ (marginRemove が true の場合のみ有効)
+		AtlasTexture,
+		ImageAndAtlasTexture,
+		/// @brief 画素を行ごとにランレングス圧縮して保持し、テクスチャは作らない (PSDLayer::compressedImage から必要なときに展開します)
+		CompressedImage,
 	};
 
 	class PSDImporter
@@ -24,14 +33,106 @@ namespace SivPSD
 			/// @brief 読み込み情報の格納先
 			StoreTarget storeTarget = StoreTarget::MipmapTexture;
 
-			/// @brief 最大スレッド数
+			/// @brief 最大スレッド数 (ワーカーのうち、この読み込みが同時に使う数)
 			int maxThreads = 3;
 
+			/// @brief 読み込みを実行するワーカー (nullptr の場合は PSDWorkerPool::Global())
+			std::shared_ptr<PSDWorkerPool> workerPool{};
+
 			/// @brief 非同期にするか
 			bool asyncStart = false;
 
 			/// @brief レイヤーの余白を除くか ( false の場合、すべてのレイヤーが同じサイズ になります )
 			bool marginRemove = true;
+
+			/// @brief marginRemove が true の場合、さらにアルファが 0 でない画素を囲む範囲までレイヤーを切り詰めるか (すべて透明なレイヤーは画像とテクスチャを持ちません)
+			bool trimTransparent = false;
+
+			/// @brief 画素が同じレイヤー同士でテクスチャ (アトラスの場合はページ内の領域) を共有するか (getDedupStats() で削減量を取得できます。StoreTarget::Image と lazyDecode が true の場合は無効)
+			/// @remark インターリーブ中に求めた画素のハッシュが一致するレイヤーを、画素を比較してから共有します。比較のため、読み込み中は全レイヤーの画像を保持します。画像 (PSDLayer::image) は共有せず、レイヤーごとに持ちます
+			bool deduplicateLayers = false;
+
+			/// @brief この画素数を超えるレイヤーはチャンネルを行単位に分割し、複数スレッドで展開します
+			int rowSplitThreshold = 2048 * 2048;
+
+			/// @brief レイヤーの読み込みが完了するたびに呼ばれる関数 (読み込みスレッドから呼ばれます。アトラスに格納する場合は全レイヤーの詰め込み後に、クリッピングを焼き込むレイヤーとその土台は全レイヤーの展開後に呼ばれます)
+			std::function<void(const PSDLayer&)> onLayerReady{};
+
+			/// @brief 開く際はレイヤー情報のみを読み込み、画素は getDecodedLayer() で要求されたときに展開するか
+			/// @remark 展開に備えてファイルをマップしたままにします。一時ファイルからの置き換えによる上書き保存は妨げませんが、同じファイルを直接書き換えた場合は展開結果が壊れることがあります (Windows 以外で切り詰められた場合は読み込み時に異常終了します)
+			bool lazyDecode = false;
+
+			/// @brief lazyDecode が true のとき、展開済みレイヤーを保持する最大バイト数 (超えた場合は長く使われていないものから破棄します)
+			size_t decodedCacheBytes = 512 * 1024 * 1024;
+
+			/// @brief アトラスページの大きさ (これに収まらないレイヤーは単体のテクスチャになります)
+			Size atlasPageSize{4096, 4096};
+
+			/// @brief アトラス内で隣り合うレイヤーの間に空ける画素数
+			int32 atlasPadding = 1;
+
+			/// @brief 展開済みのレイヤーをキャッシュファイルに保存し、次回以降は元ファイルが変わっていなければそこから読み込むか (lazyDecode, keepFloatImage が true の場合は無効)
+			bool useCacheFile = false;
+
+			/// @brief キャッシュファイルを置くディレクトリ (空の場合は元ファイルと同じディレクトリ)
+			FilePath cacheDirectory{};
+
+			/// @brief ファイルの変更を監視し、update() で reload() を開始するか
+			bool watchFile = false;
+
+			/// @brief 16/32 ビットのドキュメントを 8 ビットに変換する際、順序ディザで丸めるか
+			bool dither = false;
+
+			/// @brief 16/32 ビットのドキュメントで、精度を保った画素配列 (PSDLayer::floatImage) も格納するか (キャッシュファイルは使用されなくなります)
+			bool keepFloatImage = false;
+
+			/// @brief レイヤーマスクをアルファに焼き込むか (false の場合はマスクを無視し、レイヤーにエラーを記録します)
+			bool bakeLayerMask = true;
+
+			/// @brief ファイルに保存されたベクトルマスクのラスタライズ結果をアルファに焼き込むか
+			bool bakeVectorMask = false;
+
+			/// @brief クリッピングマスクのレイヤーに土台のレイヤーのアルファを焼き込むか (lazyDecode が true の場合は無効)
+			bool bakeClipping = true;
+
+			/// @brief 互換性を優先して保存された PSD に含まれる統合画像を、レイヤーより先に展開するか (getPreviewImage() で取得できます。キャッシュファイルから読み込む場合は展開されません)
+			bool decodePreview = false;
+
+			/// @brief 統合画像のみを展開し、レイヤーは読み込まないか (サムネイルの作成用)
+			bool previewOnly = false;
+
+			/// @brief 段階ごとの時間や読み込み量を計測するか (getImportStats() で取得できます。false の場合は計測のコストはかかりません)
+			bool collectStats = false;
+
+			/// @brief collectStats が true のとき、スレッドごとの時系列も記録するか (ImportStats::exportChromeTrace() で書き出せます)
+			bool collectTrace = false;
+
+			/// @brief ImportStats::slowestLayers に残すレイヤー数
+			int32 statsSlowestLayers = 10;
+		};
+
+		/// @brief 画素が同じレイヤー同士でテクスチャを共有した結果
+		struct DedupStats
+		{
+			/// @brief 他のレイヤーとテクスチャを共有したレイヤー数 (作らずに済んだテクスチャの数)
+			int32 sharedLayers{};
+
+			/// @brief 共有によって確保せずに済んだテクスチャ (アトラスの場合はページ内の領域) のおおよそのバイト数
+			uint64 savedTextureBytes{};
+		};
+
+		/// @brief 読み込みの進捗
+		struct Progress
+		{
+			/// @brief 読み込みが完了したレイヤー数
+			int32 completed{};
+
+			/// @brief 全レイヤー数 (レイヤー情報の解析前は 0)
+			int32 total{};
+
+			/// @brief 完了したレイヤーの割合 [0, 1]
+			[[nodiscard]]
+			double rate() const noexcept;
 		};
 
 		PSDImporter();
@@ -42,15 +143,84 @@ namespace SivPSD
 		[[nodiscard]]
 		Optional<PSDError> getCriticalError() const;
 
-		/// @brief 読み込んだオブジェクト
+		/// @brief 読み込んだオブジェクト (lazyDecode が true の場合はレイヤー情報のみで、画素を含みません)
+		/// @remark StoreTarget::Image などでは全レイヤーの画素を複製するため、大きなドキュメントでは getObjectRef(), getObjectShared(), takeObject() を使ってください
 		[[nodiscard]]
 		PSDObject getObject() const;
 
+		/// @brief 読み込んだオブジェクトを複製せずに参照します (読み込みが完了していない場合は空のオブジェクト)
+		/// @remark reload(), takeObject() を呼ぶかインポーターを破棄するまで有効です
+		[[nodiscard]]
+		const PSDObject& getObjectRef() const;
+
+		/// @brief 読み込んだオブジェクトを複製せずに共有します (読み込みが完了していない場合は空のオブジェクト)
+		/// @remark reload() やインポーターの破棄の後も有効で、内容は変わりません
+		[[nodiscard]]
+		std::shared_ptr<const PSDObject> getObjectShared() const;
+
+		/// @brief 読み込んだオブジェクトを取り出し、インポーターには空のオブジェクトを残します (読み込みが完了していない場合は空のオブジェクト)
+		/// @remark 取り出した後は getLayer() などはレイヤーを返しません。getObjectShared() で共有中の場合は、共有先の内容を保つため複製します
+		[[nodiscard]]
+		PSDObject takeObject();
+
 		/// @brief 読み込みが完了しているか
 		[[nodiscard]]
 		bool isReady() const noexcept;
 
+		/// @brief 指定したレイヤーの読み込みが完了しているか
+		[[nodiscard]]
+		bool isLayerReady(PSDLayer::id_type id) const noexcept;
+
+		/// @brief 読み込みが完了したレイヤー (未完了の場合は none)
+		[[nodiscard]]
+		Optional<PSDLayer> getLayer(PSDLayer::id_type id) const;
+
+		/// @brief 読み込みの進捗
+		[[nodiscard]]
+		Progress getProgress() const noexcept;
+
+		/// @brief 画素を含むレイヤー (lazyDecode が true の場合は初回の呼び出しで展開し、キャッシュします)
+		[[nodiscard]]
+		Optional<PSDLayer> getDecodedLayer(PSDLayer::id_type id) const;
+
+		/// @brief 統合画像のプレビューの展開が完了しているか
+		[[nodiscard]]
+		bool isPreviewReady() const noexcept;
+
+		/// @brief 統合画像のプレビュー (decodePreview または previewOnly が true で、展開が完了している場合のみ)
+		[[nodiscard]]
+		Image getPreviewImage() const;
+
+		/// @brief 統合画像のプレビューのテクスチャ (格納先がテクスチャを含む場合のみ)
+		[[nodiscard]]
+		DynamicTexture getPreviewTexture() const;
+
+		/// @brief 読み込みの計測結果 (collectStats が true で、読み込みが完了している場合のみ。lazyDecode が true の場合は開くまでの計測です)
+		[[nodiscard]]
+		ImportStats getImportStats() const;
+
+		/// @brief deduplicateLayers が true のとき、テクスチャを共有したレイヤー数と削減したバイト数 (読み込みが完了している場合のみ)
+		[[nodiscard]]
+		DedupStats getDedupStats() const;
+
+		/// @brief lazyDecode が true のとき、キャッシュされている展開済みレイヤーのおおよそのバイト数
+		[[nodiscard]]
+		size_t getCachedBytes() const;
+
+		/// @brief ファイルを読み込み直します (前回から画素と矩形、名前が変わっていないレイヤーは展開せず、画像とテクスチャを使い回します)
+		/// @remark 完了するまで getObject() は空を返すため、描画には直前のオブジェクトを使ってください
+		void reload();
+
+		/// @brief watchFile が true のとき、ファイルの変更が落ち着いていれば reload() を開始します (毎フレーム呼んでください)
+		/// @return reload() を開始した場合 true
+		bool update();
+
 	private:
+		friend class PSDBatchImporter;
+
+		/// @brief 共有のワーカーで読み込みます (PSDBatchImporter 用)
+		PSDImporter(const Config& config, std::unique_ptr<ImportScheduler> scheduler);
+
 		struct Impl;
 		std::shared_ptr<Impl> p_impl;
 	};
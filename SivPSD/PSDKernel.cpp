@@ -0,0 +1,1322 @@
+﻿#include "stdafx.h"
+#include "PSDKernel.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SIVPSD_KERNEL_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define SIVPSD_KERNEL_X64 0
+#endif
+
+// MSVC は命令セットの指定なしで AVX2 組み込み関数を使用できる
+#if SIVPSD_KERNEL_X64 && !defined(_MSC_VER)
+#define SIVPSD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIVPSD_TARGET_AVX2
+#endif
+
+namespace
+{
+	using namespace SivPSD;
+	using namespace SivPSD::Kernel;
+
+	void interleaveScalar(
+		const uint8* srcR, const uint8* srcG, const uint8* srcB, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			dest[i] = Color(srcR[i], srcG[i], srcB[i], srcA[i]);
+		}
+	}
+
+#if SIVPSD_KERNEL_X64
+	void interleaveSSE2(
+		const uint8* srcR, const uint8* srcG, const uint8* srcB, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcR + i));
+			const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcG + i));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcB + i));
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcA + i));
+
+			const __m128i rgLo = _mm_unpacklo_epi8(r, g);
+			const __m128i rgHi = _mm_unpackhi_epi8(r, g);
+			const __m128i baLo = _mm_unpacklo_epi8(b, a);
+			const __m128i baHi = _mm_unpackhi_epi8(b, a);
+
+			auto out = reinterpret_cast<__m128i*>(dest + i);
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rgLo, baLo));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+		}
+
+		interleaveScalar(srcR + i, srcG + i, srcB + i, srcA + i, dest + i, count - i);
+	}
+
+	SIVPSD_TARGET_AVX2
+	void interleaveAVX2(
+		const uint8* srcR, const uint8* srcG, const uint8* srcB, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcR + i));
+			const __m256i g = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcG + i));
+			const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcB + i));
+			const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcA + i));
+
+			// unpack は 128-bit レーン内で行われるため、最後にレーンを並べ替える
+			const __m256i rgLo = _mm256_unpacklo_epi8(r, g);
+			const __m256i rgHi = _mm256_unpackhi_epi8(r, g);
+			const __m256i baLo = _mm256_unpacklo_epi8(b, a);
+			const __m256i baHi = _mm256_unpackhi_epi8(b, a);
+
+			const __m256i p0 = _mm256_unpacklo_epi16(rgLo, baLo); // 0-3, 16-19
+			const __m256i p1 = _mm256_unpackhi_epi16(rgLo, baLo); // 4-7, 20-23
+			const __m256i p2 = _mm256_unpacklo_epi16(rgHi, baHi); // 8-11, 24-27
+			const __m256i p3 = _mm256_unpackhi_epi16(rgHi, baHi); // 12-15, 28-31
+
+			auto out = reinterpret_cast<__m256i*>(dest + i);
+			_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+			_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+			_mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+			_mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+		}
+
+		interleaveSSE2(srcR + i, srcG + i, srcB + i, srcA + i, dest + i, count - i);
+	}
+
+	bool hasAVX2()
+	{
+#if defined(_MSC_VER)
+		int info[4]{};
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		// OS が YMM レジスタを保存するか
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (not osxsave || not avx) return false;
+		if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	/// @brief 4x4 の順序ディザ行列
+	constexpr std::array<std::array<uint8, 4>, 4> BayerMatrix{{
+		{0, 8, 2, 10},
+		{12, 4, 14, 6},
+		{3, 11, 1, 9},
+		{15, 7, 13, 5},
+	}};
+
+	/// @brief 16 ビット値を 8 ビットに丸める際、v * 255 に加える閾値 (ディザなしは四捨五入)
+	std::array<uint32, 4> getDitherThresholds16(Optional<int32> ditherRow)
+	{
+		std::array<uint32, 4> thresholds{};
+		for (int x = 0; x < 4; ++x)
+		{
+			thresholds[x] = ditherRow ? (BayerMatrix[*ditherRow & 3][x] * 2 + 1) * 2048 : 32895;
+		}
+		return thresholds;
+	}
+
+	void interleave16Scalar(
+		const uint16* srcR, const uint16* srcG, const uint16* srcB, const uint16* srcA,
+		Color* dest, size_t count, size_t x, const std::array<uint32, 4>& thresholds)
+	{
+		for (size_t i = 0; i < count; ++i, ++x)
+		{
+			const uint32 t = thresholds[x & 3];
+			dest[i] = Color(
+				static_cast<uint8>((srcR[i] * 255u + t) >> 16),
+				static_cast<uint8>((srcG[i] * 255u + t) >> 16),
+				static_cast<uint8>((srcB[i] * 255u + t) >> 16),
+				static_cast<uint8>((srcA[i] * 255u + t) >> 16));
+		}
+	}
+
+#if SIVPSD_KERNEL_X64
+	/// @brief 8 つの 16 ビット値を (v * 255 + t) >> 16 で 8 ビットに丸める
+	/// @param carryThresholds 下位 16 ビットがこれを超えると繰り上がる値 (65535 - t) を符号付きの比較用に 0x8000 と排他的論理和をとったもの
+	__m128i narrow16SSE2(__m128i v, __m128i carryThresholds)
+	{
+		const __m128i k255 = _mm_set1_epi16(255);
+		const __m128i lo = _mm_mullo_epi16(v, k255);
+		const __m128i hi = _mm_mulhi_epu16(v, k255);
+		const __m128i carry = _mm_cmpgt_epi16(_mm_xor_si128(lo, _mm_set1_epi16(static_cast<int16>(0x8000))), carryThresholds);
+		return _mm_sub_epi16(hi, carry);
+	}
+
+	void interleave16SSE2(
+		const uint16* srcR, const uint16* srcG, const uint16* srcB, const uint16* srcA,
+		Color* dest, size_t count, const std::array<uint32, 4>& thresholds)
+	{
+		std::array<int16, 8> carryThresholds{};
+		for (int x = 0; x < 8; ++x)
+		{
+			carryThresholds[x] = static_cast<int16>((65535 - thresholds[x & 3]) ^ 0x8000);
+		}
+		const __m128i ct = _mm_loadu_si128(reinterpret_cast<const __m128i*>(carryThresholds.data()));
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i r = narrow16SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcR + i)), ct);
+			const __m128i g = narrow16SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcG + i)), ct);
+			const __m128i b = narrow16SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcB + i)), ct);
+			const __m128i a = narrow16SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcA + i)), ct);
+
+			// 16 ビットの各レーンに下位から R, G (B, A) の順で詰める
+			const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+			const __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+
+			auto out = reinterpret_cast<__m128i*>(dest + i);
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rg, ba));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg, ba));
+		}
+
+		interleave16Scalar(srcR + i, srcG + i, srcB + i, srcA + i, dest + i, count - i, i, thresholds);
+	}
+#endif
+
+	/// @brief リニアな [0, 1] を LinearToSRGBTableSize 段階で引く sRGB の値 (0-255)
+	constexpr size_t LinearToSRGBTableSize = 4096;
+
+	const std::array<float, LinearToSRGBTableSize>& getLinearToSRGBTable()
+	{
+		static const auto table = []()
+		{
+			std::array<float, LinearToSRGBTableSize> t{};
+			for (size_t i = 0; i < t.size(); ++i)
+			{
+				const double v = static_cast<double>(i) / (t.size() - 1);
+				const double srgb = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+				t[i] = static_cast<float>(srgb * 255.0);
+			}
+			return t;
+		}();
+		return table;
+	}
+
+	/// @brief [0, 1] に収める (NaN は 0 にする)
+	float clamp01(float v)
+	{
+		return v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+	}
+
+	size_t toTableIndex(float v)
+	{
+		return static_cast<size_t>(clamp01(v) * (LinearToSRGBTableSize - 1) + 0.5f);
+	}
+
+	uint8 quantize(float v255, float threshold)
+	{
+		return static_cast<uint8>(Min(v255 + threshold, 255.0f));
+	}
+
+	/// @brief getLinearToSRGBTable を 8 ビットに丸めたもの
+	const std::array<uint8, LinearToSRGBTableSize>& getLinearToSRGB8Table()
+	{
+		static const auto table = []()
+		{
+			std::array<uint8, LinearToSRGBTableSize> t{};
+			const auto& source = getLinearToSRGBTable();
+			for (size_t i = 0; i < t.size(); ++i) t[i] = quantize(source[i], 0.5f);
+			return t;
+		}();
+		return table;
+	}
+
+	/// @brief getLinearToSRGB8Table を 32 ビットに広げたもの (gather とシフトで Color のチャンネルに置くため)
+	const std::array<uint32, LinearToSRGBTableSize>& getLinearToSRGB32Table()
+	{
+		static const auto table = []()
+		{
+			std::array<uint32, LinearToSRGBTableSize> t{};
+			const auto& source = getLinearToSRGB8Table();
+			for (size_t i = 0; i < t.size(); ++i) t[i] = source[i];
+			return t;
+		}();
+		return table;
+	}
+
+	/// @brief 32 ビット浮動小数点を 8 ビットに丸める際、v * 255 に加える閾値 (ディザなしは四捨五入)
+	std::array<float, 4> getDitherThresholdsFloat(Optional<int32> ditherRow)
+	{
+		std::array<float, 4> thresholds{};
+		for (int x = 0; x < 4; ++x)
+		{
+			thresholds[x] = ditherRow ? (BayerMatrix[*ditherRow & 3][x] + 0.5f) / 16.0f : 0.5f;
+		}
+		return thresholds;
+	}
+
+	// 色はテーブル引きで sRGB に、アルファはリニアのまま 8 ビットにする
+	void interleaveFloatScalar(
+		const float* srcR, const float* srcG, const float* srcB, const float* srcA,
+		Color* dest, size_t count, size_t x, const std::array<float, 4>& thresholds)
+	{
+		const auto& table = getLinearToSRGBTable();
+		for (size_t i = 0; i < count; ++i, ++x)
+		{
+			const float t = thresholds[x & 3];
+			dest[i] = Color(
+				quantize(table[toTableIndex(srcR[i])], t),
+				quantize(table[toTableIndex(srcG[i])], t),
+				quantize(table[toTableIndex(srcB[i])], t),
+				quantize(clamp01(srcA[i]) * 255.0f, t));
+		}
+	}
+
+	void interleaveToFloat4Scalar(
+		const uint16* srcR, const uint16* srcG, const uint16* srcB, const uint16* srcA,
+		Float4* dest, size_t count)
+	{
+		constexpr float scale = 1.0f / 65535.0f;
+		for (size_t i = 0; i < count; ++i)
+		{
+			dest[i] = Float4{srcR[i] * scale, srcG[i] * scale, srcB[i] * scale, srcA[i] * scale};
+		}
+	}
+
+	void interleaveToFloat4Scalar(
+		const float* srcR, const float* srcG, const float* srcB, const float* srcA,
+		Float4* dest, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			dest[i] = Float4{srcR[i], srcG[i], srcB[i], srcA[i]};
+		}
+	}
+
+#if SIVPSD_KERNEL_X64
+	/// @brief clamp01 と同じく [0, 1] に収める (maxps は NaN の場合に第2引数を返すため 0 になる)
+	__m128 clamp01SSE2(__m128 v)
+	{
+		return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	}
+
+	/// @brief 4 つの値を toTableIndex と同じ計算でテーブルから引く
+	__m128 lookupSRGBSSE2(const std::array<float, LinearToSRGBTableSize>& table, __m128 v)
+	{
+		const __m128 scaled = _mm_add_ps(
+			_mm_mul_ps(clamp01SSE2(v), _mm_set1_ps(static_cast<float>(LinearToSRGBTableSize - 1))), _mm_set1_ps(0.5f));
+		alignas(16) std::array<int32, 4> indices{};
+		_mm_store_si128(reinterpret_cast<__m128i*>(indices.data()), _mm_cvttps_epi32(scaled));
+		return _mm_setr_ps(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]);
+	}
+
+	/// @brief quantize と同じく閾値を加えて 255 で抑え、切り捨てる
+	__m128i quantizeSSE2(__m128 v255, __m128 thresholds)
+	{
+		return _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(v255, thresholds), _mm_set1_ps(255.0f)));
+	}
+
+	// 丸めはスカラー版と同じ単精度の演算で行うため、結果は一致する (テーブル引きのみスカラー)
+	void interleaveFloatSSE2(
+		const float* srcR, const float* srcG, const float* srcB, const float* srcA,
+		Color* dest, size_t count, const std::array<float, 4>& thresholds)
+	{
+		const auto& table = getLinearToSRGBTable();
+		const __m128 t = _mm_loadu_ps(thresholds.data());
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128i r = quantizeSSE2(lookupSRGBSSE2(table, _mm_loadu_ps(srcR + i)), t);
+			const __m128i g = quantizeSSE2(lookupSRGBSSE2(table, _mm_loadu_ps(srcG + i)), t);
+			const __m128i b = quantizeSSE2(lookupSRGBSSE2(table, _mm_loadu_ps(srcB + i)), t);
+			const __m128i a = quantizeSSE2(_mm_mul_ps(clamp01SSE2(_mm_loadu_ps(srcA + i)), _mm_set1_ps(255.0f)), t);
+
+			// 各値は [0, 255] のため、32 ビットのレーンに R, G, B, A の順で詰める
+			const __m128i rgba = _mm_or_si128(
+				_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(a, 24)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), rgba);
+		}
+
+		interleaveFloatScalar(srcR + i, srcG + i, srcB + i, srcA + i, dest + i, count - i, i, thresholds);
+	}
+
+	/// @brief 4 チャンネル分の 4 画素を転置して Float4 として書き込む
+	void storeFloat4SSE2(__m128 r, __m128 g, __m128 b, __m128 a, Float4* dest)
+	{
+		_MM_TRANSPOSE4_PS(r, g, b, a);
+		auto out = reinterpret_cast<float*>(dest);
+		_mm_storeu_ps(out + 0, r);
+		_mm_storeu_ps(out + 4, g);
+		_mm_storeu_ps(out + 8, b);
+		_mm_storeu_ps(out + 12, a);
+	}
+
+	void interleaveToFloat4SSE2(
+		const uint16* srcR, const uint16* srcG, const uint16* srcB, const uint16* srcA,
+		Float4* dest, size_t count)
+	{
+		static_assert(sizeof(Float4) == sizeof(float) * 4);
+		const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+		const __m128i zero = _mm_setzero_si128();
+		const auto toFloat = [&](const uint16* src, bool high)
+		{
+			const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + (high ? 4 : 0)));
+			return _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale);
+		};
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			for (const bool high : {false, true})
+			{
+				storeFloat4SSE2(
+					toFloat(srcR + i, high), toFloat(srcG + i, high), toFloat(srcB + i, high), toFloat(srcA + i, high),
+					dest + i + (high ? 4 : 0));
+			}
+		}
+
+		interleaveToFloat4Scalar(srcR + i, srcG + i, srcB + i, srcA + i, dest + i, count - i);
+	}
+
+	void interleaveToFloat4SSE2(
+		const float* srcR, const float* srcG, const float* srcB, const float* srcA,
+		Float4* dest, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			storeFloat4SSE2(
+				_mm_loadu_ps(srcR + i), _mm_loadu_ps(srcG + i), _mm_loadu_ps(srcB + i), _mm_loadu_ps(srcA + i),
+				dest + i);
+		}
+
+		interleaveToFloat4Scalar(srcR + i, srcG + i, srcB + i, srcA + i, dest + i, count - i);
+	}
+#endif
+
+	void interleaveGrayScalar(const uint8* srcGray, const uint8* srcA, Color* dest, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			dest[i] = Color(srcGray[i], srcGray[i], srcGray[i], srcA[i]);
+		}
+	}
+
+	/// @brief a * b / 255 を四捨五入
+	uint8 mulDiv255(uint32 a, uint32 b)
+	{
+		const uint32 t = a * b + 128;
+		return static_cast<uint8>((t + (t >> 8)) >> 8);
+	}
+
+	void multiplyAlphaScalar(Color* dest, const uint8* mask, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i) dest[i].a = mulDiv255(dest[i].a, mask[i]);
+	}
+
+	void multiplyAlphaScalar(Color* dest, const Color* src, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i) dest[i].a = mulDiv255(dest[i].a, src[i].a);
+	}
+
+	void interleaveCMYKScalar(
+		const uint8* srcC, const uint8* srcM, const uint8* srcY, const uint8* srcK, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			dest[i] = Color(mulDiv255(srcC[i], srcK[i]), mulDiv255(srcM[i], srcK[i]), mulDiv255(srcY[i], srcK[i]), srcA[i]);
+		}
+	}
+
+	// D50 の白色点と、Bradford 変換で D65 に順応させた XYZ からリニア sRGB への行列
+	constexpr float LabWhiteX = 0.9642f;
+	constexpr float LabWhiteZ = 0.8251f;
+	constexpr std::array<float, 9> XYZToLinearSRGB{
+		3.1338561f, -1.6168667f, -0.4906146f,
+		-0.9787684f, 1.9161415f, 0.0334540f,
+		0.0719453f, -0.2289914f, 1.4052427f,
+	};
+
+	/// @brief L (0-255) から fy = (L * 100 / 255 + 16) / 116 を求める係数
+	constexpr float LabFyScale = 100.0f / (255.0f * 116.0f);
+	constexpr float LabFyOffset = 16.0f / 116.0f;
+
+	/// @brief Lab の f(t) の逆関数
+	float labFInverse(float t)
+	{
+		constexpr float delta = 6.0f / 29.0f;
+		return t > delta ? t * t * t : 3.0f * delta * delta * (t - 4.0f / 29.0f);
+	}
+
+	/// @brief Lab の各チャンネルの 8 ビット値から引く値 (x と z の f⁻¹ は 2 チャンネルに依存するため画素ごとに求める)
+	/// @remark SIMD の実装は表を引くより速いため同じ式をそのまま計算し、結果をスカラーとそろえる
+	struct LabTables
+	{
+		/// @brief L から求める fy
+		std::array<float, 256> fy;
+
+		/// @brief L から求める Y (= f⁻¹(fy))
+		std::array<float, 256> y;
+
+		/// @brief a から求める fx - fy
+		std::array<float, 256> a;
+
+		/// @brief b から求める fy - fz
+		std::array<float, 256> b;
+	};
+
+	const LabTables& getLabTables()
+	{
+		static const auto tables = []()
+		{
+			LabTables t{};
+			for (int i = 0; i < 256; ++i)
+			{
+				t.fy[i] = i * LabFyScale + LabFyOffset;
+				t.y[i] = labFInverse(t.fy[i]);
+				t.a[i] = (i - 128.0f) * (1.0f / 500.0f);
+				t.b[i] = (i - 128.0f) * (1.0f / 200.0f);
+			}
+			return t;
+		}();
+		return tables;
+	}
+
+	void interleaveLabScalar(
+		const uint8* srcL, const uint8* srcLabA, const uint8* srcLabB, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		const auto& table = getLinearToSRGB8Table();
+		const auto& lab = getLabTables();
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float fy = lab.fy[srcL[i]];
+			const float x = LabWhiteX * labFInverse(fy + lab.a[srcLabA[i]]);
+			const float y = lab.y[srcL[i]];
+			const float z = LabWhiteZ * labFInverse(fy - lab.b[srcLabB[i]]);
+			const auto& m = XYZToLinearSRGB;
+			dest[i] = Color(
+				table[toTableIndex(m[0] * x + m[1] * y + m[2] * z)],
+				table[toTableIndex(m[3] * x + m[4] * y + m[5] * z)],
+				table[toTableIndex(m[6] * x + m[7] * y + m[8] * z)],
+				srcA[i]);
+		}
+	}
+
+#if SIVPSD_KERNEL_X64
+	void interleaveGraySSE2(const uint8* srcGray, const uint8* srcA, Color* dest, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcGray + i));
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcA + i));
+
+			const __m128i rgLo = _mm_unpacklo_epi8(v, v);
+			const __m128i rgHi = _mm_unpackhi_epi8(v, v);
+			const __m128i baLo = _mm_unpacklo_epi8(v, a);
+			const __m128i baHi = _mm_unpackhi_epi8(v, a);
+
+			auto out = reinterpret_cast<__m128i*>(dest + i);
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rgLo, baLo));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+		}
+
+		interleaveGrayScalar(srcGray + i, srcA + i, dest + i, count - i);
+	}
+
+	/// @brief 8 つの 16 ビット値どうしの a * b / 255 を四捨五入
+	__m128i mulDiv255SSE2(__m128i a, __m128i b)
+	{
+		const __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	}
+
+	/// @brief 8 画素のアルファに 16 ビットの各レーンの値 / 255 を乗算
+	void multiplyAlpha8SSE2(Color* dest, __m128i mask16)
+	{
+		auto p = reinterpret_cast<__m128i*>(dest);
+		const __m128i p0 = _mm_loadu_si128(p);
+		const __m128i p1 = _mm_loadu_si128(p + 1);
+		const __m128i alpha = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+		const __m128i result = mulDiv255SSE2(alpha, mask16);
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+		_mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(p0, rgb), _mm_slli_epi32(_mm_unpacklo_epi16(result, zero), 24)));
+		_mm_storeu_si128(p + 1, _mm_or_si128(_mm_and_si128(p1, rgb), _mm_slli_epi32(_mm_unpackhi_epi16(result, zero), 24)));
+	}
+
+	void multiplyAlphaSSE2(Color* dest, const uint8* mask, size_t count)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i m = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask + i)), zero);
+			multiplyAlpha8SSE2(dest + i, m);
+		}
+		multiplyAlphaScalar(dest + i, mask + i, count - i);
+	}
+
+	void multiplyAlphaSSE2(Color* dest, const Color* src, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const auto s = reinterpret_cast<const __m128i*>(src + i);
+			const __m128i m = _mm_packs_epi32(
+				_mm_srli_epi32(_mm_loadu_si128(s), 24), _mm_srli_epi32(_mm_loadu_si128(s + 1), 24));
+			multiplyAlpha8SSE2(dest + i, m);
+		}
+		multiplyAlphaScalar(dest + i, src + i, count - i);
+	}
+
+	/// @brief 16 画素の c * k / 255 を 8 ビットで求める
+	__m128i applyBlackSSE2(__m128i c, __m128i kLo, __m128i kHi)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i lo = mulDiv255SSE2(_mm_unpacklo_epi8(c, zero), kLo);
+		const __m128i hi = mulDiv255SSE2(_mm_unpackhi_epi8(c, zero), kHi);
+		return _mm_packus_epi16(lo, hi);
+	}
+
+	void interleaveCMYKSSE2(
+		const uint8* srcC, const uint8* srcM, const uint8* srcY, const uint8* srcK, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcK + i));
+			const __m128i kLo = _mm_unpacklo_epi8(k, zero);
+			const __m128i kHi = _mm_unpackhi_epi8(k, zero);
+			const __m128i r = applyBlackSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcC + i)), kLo, kHi);
+			const __m128i g = applyBlackSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcM + i)), kLo, kHi);
+			const __m128i b = applyBlackSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcY + i)), kLo, kHi);
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcA + i));
+
+			const __m128i rgLo = _mm_unpacklo_epi8(r, g);
+			const __m128i rgHi = _mm_unpackhi_epi8(r, g);
+			const __m128i baLo = _mm_unpacklo_epi8(b, a);
+			const __m128i baHi = _mm_unpackhi_epi8(b, a);
+
+			auto out = reinterpret_cast<__m128i*>(dest + i);
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rgLo, baLo));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+		}
+
+		interleaveCMYKScalar(srcC + i, srcM + i, srcY + i, srcK + i, srcA + i, dest + i, count - i);
+	}
+
+	/// @brief 4 つの 8 ビット値を float にする
+	__m128 loadFloat4SSE2(const uint8* src)
+	{
+		int32 packed;
+		std::memcpy(&packed, src, sizeof(packed));
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+		return _mm_cvtepi32_ps(v);
+	}
+
+	__m128 labFInverseSSE2(__m128 t)
+	{
+		constexpr float delta = 6.0f / 29.0f;
+		const __m128 cube = _mm_mul_ps(_mm_mul_ps(t, t), t);
+		const __m128 linear = _mm_mul_ps(
+			_mm_set1_ps(3.0f * delta * delta), _mm_sub_ps(t, _mm_set1_ps(4.0f / 29.0f)));
+		const __m128 mask = _mm_cmpgt_ps(t, _mm_set1_ps(delta));
+		return _mm_or_ps(_mm_and_ps(mask, cube), _mm_andnot_ps(mask, linear));
+	}
+
+	/// @brief リニアな値を getLinearToSRGB8Table の番号にする (範囲外と NaN は端に収める)
+	__m128i toTableIndexSSE2(__m128 v)
+	{
+		const __m128 clamped = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		return _mm_cvttps_epi32(_mm_add_ps(
+			_mm_mul_ps(clamped, _mm_set1_ps(static_cast<float>(LinearToSRGBTableSize - 1))), _mm_set1_ps(0.5f)));
+	}
+
+	void interleaveLabSSE2(
+		const uint8* srcL, const uint8* srcLabA, const uint8* srcLabB, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		const auto& table = getLinearToSRGB32Table();
+		const auto& m = XYZToLinearSRGB;
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			// 4 画素ずつ getLabTables と同じ式でリニア sRGB まで求め、ガンマはテーブルで引く
+			const __m128 offset = _mm_set1_ps(128.0f);
+			const __m128 fy = _mm_add_ps(
+				_mm_mul_ps(loadFloat4SSE2(srcL + i), _mm_set1_ps(LabFyScale)), _mm_set1_ps(LabFyOffset));
+			const __m128 fx = _mm_add_ps(
+				fy, _mm_mul_ps(_mm_sub_ps(loadFloat4SSE2(srcLabA + i), offset), _mm_set1_ps(1.0f / 500.0f)));
+			const __m128 fz = _mm_sub_ps(
+				fy, _mm_mul_ps(_mm_sub_ps(loadFloat4SSE2(srcLabB + i), offset), _mm_set1_ps(1.0f / 200.0f)));
+			const __m128 x = _mm_mul_ps(_mm_set1_ps(LabWhiteX), labFInverseSSE2(fx));
+			const __m128 y = labFInverseSSE2(fy);
+			const __m128 z = _mm_mul_ps(_mm_set1_ps(LabWhiteZ), labFInverseSSE2(fz));
+
+			const auto row = [&](size_t r)
+			{
+				return toTableIndexSSE2(_mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[r * 3]), x), _mm_mul_ps(_mm_set1_ps(m[r * 3 + 1]), y)),
+					_mm_mul_ps(_mm_set1_ps(m[r * 3 + 2]), z)));
+			};
+			alignas(16) std::array<std::array<int32, 4>, 3> indices;
+			_mm_store_si128(reinterpret_cast<__m128i*>(indices[0].data()), row(0));
+			_mm_store_si128(reinterpret_cast<__m128i*>(indices[1].data()), row(1));
+			_mm_store_si128(reinterpret_cast<__m128i*>(indices[2].data()), row(2));
+
+			std::array<uint32, 4> pixels;
+			for (size_t j = 0; j < 4; ++j)
+			{
+				pixels[j] = table[indices[0][j]] | (table[indices[1][j]] << 8) | (table[indices[2][j]] << 16)
+					| (static_cast<uint32>(srcA[i + j]) << 24);
+			}
+			std::memcpy(dest + i, pixels.data(), sizeof(pixels));
+		}
+
+		interleaveLabScalar(srcL + i, srcLabA + i, srcLabB + i, srcA + i, dest + i, count - i);
+	}
+
+	SIVPSD_TARGET_AVX2
+	__m256 labFInverseAVX2(__m256 t)
+	{
+		constexpr float delta = 6.0f / 29.0f;
+		const __m256 cube = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+		const __m256 linear = _mm256_mul_ps(
+			_mm256_set1_ps(3.0f * delta * delta), _mm256_sub_ps(t, _mm256_set1_ps(4.0f / 29.0f)));
+		return _mm256_blendv_ps(linear, cube, _mm256_cmp_ps(t, _mm256_set1_ps(delta), _CMP_GT_OQ));
+	}
+
+	/// @brief 8 つの 8 ビット値を 32 ビットに広げる
+	SIVPSD_TARGET_AVX2
+	__m256i loadIndex8AVX2(const uint8* src)
+	{
+		return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)));
+	}
+
+	/// @brief XYZ に行列の 1 行 (row) を掛けたリニアな値を sRGB の 8 ビット値にする
+	SIVPSD_TARGET_AVX2
+	__m256i lookupSRGBChannelAVX2(
+		const std::array<uint32, LinearToSRGBTableSize>& table, const float* row, __m256 x, __m256 y, __m256 z)
+	{
+		const __m256 v = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(row[0]), x), _mm256_mul_ps(_mm256_set1_ps(row[1]), y)),
+			_mm256_mul_ps(_mm256_set1_ps(row[2]), z));
+		const __m256 clamped = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+		const __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(
+			_mm256_mul_ps(clamped, _mm256_set1_ps(static_cast<float>(LinearToSRGBTableSize - 1))), _mm256_set1_ps(0.5f)));
+		return _mm256_i32gather_epi32(reinterpret_cast<const int*>(table.data()), index, 4);
+	}
+
+	// 8 画素ずつ getLabTables と同じ式でリニア sRGB まで求め、ガンマのテーブルのみ gather で引く
+	SIVPSD_TARGET_AVX2
+	void interleaveLabAVX2(
+		const uint8* srcL, const uint8* srcLabA, const uint8* srcLabB, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		const auto& table = getLinearToSRGB32Table();
+		const auto& m = XYZToLinearSRGB;
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 l = _mm256_cvtepi32_ps(loadIndex8AVX2(srcL + i));
+			const __m256 fy = _mm256_add_ps(
+				_mm256_mul_ps(l, _mm256_set1_ps(LabFyScale)), _mm256_set1_ps(LabFyOffset));
+			const __m256 la = _mm256_sub_ps(_mm256_cvtepi32_ps(loadIndex8AVX2(srcLabA + i)), _mm256_set1_ps(128.0f));
+			const __m256 lb = _mm256_sub_ps(_mm256_cvtepi32_ps(loadIndex8AVX2(srcLabB + i)), _mm256_set1_ps(128.0f));
+			const __m256 fx = _mm256_add_ps(fy, _mm256_mul_ps(la, _mm256_set1_ps(1.0f / 500.0f)));
+			const __m256 fz = _mm256_sub_ps(fy, _mm256_mul_ps(lb, _mm256_set1_ps(1.0f / 200.0f)));
+			const __m256 x = _mm256_mul_ps(_mm256_set1_ps(LabWhiteX), labFInverseAVX2(fx));
+			const __m256 y = labFInverseAVX2(fy);
+			const __m256 z = _mm256_mul_ps(_mm256_set1_ps(LabWhiteZ), labFInverseAVX2(fz));
+
+			const __m256i r = lookupSRGBChannelAVX2(table, &m[0], x, y, z);
+			const __m256i g = _mm256_slli_epi32(lookupSRGBChannelAVX2(table, &m[3], x, y, z), 8);
+			const __m256i b = _mm256_slli_epi32(lookupSRGBChannelAVX2(table, &m[6], x, y, z), 16);
+			const __m256i a = _mm256_slli_epi32(loadIndex8AVX2(srcA + i), 24);
+			_mm256_storeu_si256(
+				reinterpret_cast<__m256i*>(dest + i), _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, a)));
+		}
+
+		interleaveLabSSE2(srcL + i, srcLabA + i, srcLabB + i, srcA + i, dest + i, count - i);
+	}
+#endif
+
+	/// @brief 合成モードごとの色の混合 (W3C Compositing and Blending の B(Cb, Cs))
+	template <PSDBlendMode BlendMode>
+	float blendChannel(float cb, float cs)
+	{
+		if constexpr (BlendMode == PSDBlendMode::Multiply) return cb * cs;
+		else if constexpr (BlendMode == PSDBlendMode::Screen) return cb + cs - cb * cs;
+		else if constexpr (BlendMode == PSDBlendMode::Overlay)
+			return cb <= 0.5f ? 2.0f * cb * cs : 1.0f - 2.0f * (1.0f - cb) * (1.0f - cs);
+		else if constexpr (BlendMode == PSDBlendMode::Add) return std::min(cb + cs, 1.0f);
+		else return cs;
+	}
+
+	template <PSDBlendMode BlendMode>
+	void blendScalar(Color* dest, const Color* src, size_t count, uint8 opacity)
+	{
+		constexpr float inv255 = 1.0f / 255.0f;
+		const float opacityRate = opacity * inv255;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float sa = src[i].a * inv255 * opacityRate;
+			if (sa <= 0.0f) continue;
+
+			const float ba = dest[i].a * inv255;
+			const float oa = sa + ba * (1.0f - sa);
+			const float srcRgb[3]{src[i].r * inv255, src[i].g * inv255, src[i].b * inv255};
+			const float destRgb[3]{dest[i].r * inv255, dest[i].g * inv255, dest[i].b * inv255};
+			// SSE2 の実装と同じ順序で演算し、結果をそろえる
+			const float scale = 255.0f / oa;
+			uint8 out[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				// 下地が透明な部分は src の色をそのまま使う
+				const float mixed = (1.0f - ba) * srcRgb[c] + ba * blendChannel<BlendMode>(destRgb[c], srcRgb[c]);
+				const float premultiplied = sa * mixed + (1.0f - sa) * ba * destRgb[c];
+				out[c] = static_cast<uint8>(premultiplied * scale + 0.5f);
+			}
+			dest[i] = Color(out[0], out[1], out[2], static_cast<uint8>(oa * 255.0f + 0.5f));
+		}
+	}
+
+#if SIVPSD_KERNEL_X64
+	/// @brief 4 画素の 1 チャンネル (shift ビット目から 8 ビット) を 0～1 の float にする
+	__m128 loadChannelSSE2(__m128i pixels, int shift)
+	{
+		const __m128i v = _mm_and_si128(_mm_srl_epi32(pixels, _mm_cvtsi32_si128(shift)), _mm_set1_epi32(0xFF));
+		return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / 255.0f));
+	}
+
+	/// @brief 0～255 の float を blendScalar と同じく +0.5 の切り捨てで丸め、shift ビット目に置く
+	__m128i storeChannelSSE2(__m128 v, int shift)
+	{
+		return _mm_sll_epi32(_mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f))), _mm_cvtsi32_si128(shift));
+	}
+
+	template <PSDBlendMode BlendMode>
+	__m128 blendChannelSSE2(__m128 cb, __m128 cs)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		if constexpr (BlendMode == PSDBlendMode::Multiply) return _mm_mul_ps(cb, cs);
+		else if constexpr (BlendMode == PSDBlendMode::Screen) return _mm_sub_ps(_mm_add_ps(cb, cs), _mm_mul_ps(cb, cs));
+		else if constexpr (BlendMode == PSDBlendMode::Overlay)
+		{
+			const __m128 two = _mm_set1_ps(2.0f);
+			const __m128 low = _mm_mul_ps(two, _mm_mul_ps(cb, cs));
+			const __m128 high = _mm_sub_ps(one, _mm_mul_ps(two, _mm_mul_ps(_mm_sub_ps(one, cb), _mm_sub_ps(one, cs))));
+			const __m128 mask = _mm_cmple_ps(cb, _mm_set1_ps(0.5f));
+			return _mm_or_ps(_mm_and_ps(mask, low), _mm_andnot_ps(mask, high));
+		}
+		else if constexpr (BlendMode == PSDBlendMode::Add) return _mm_min_ps(_mm_add_ps(cb, cs), one);
+		else return cs;
+	}
+
+	// 4 画素をチャンネルごとのレジスタに分けて (SoA) 処理する
+	template <PSDBlendMode BlendMode>
+	void blendSSE2(Color* dest, const Color* src, size_t count, uint8 opacity)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 opacityRate = _mm_set1_ps(opacity * (1.0f / 255.0f));
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128i srcPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			const __m128 sa = _mm_mul_ps(loadChannelSSE2(srcPixels, 24), opacityRate);
+			const __m128 visible = _mm_cmpgt_ps(sa, _mm_setzero_ps());
+			if (_mm_movemask_ps(visible) == 0) continue;
+
+			const __m128i destPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + i));
+			const __m128 ba = loadChannelSSE2(destPixels, 24);
+			const __m128 oneMinusSa = _mm_sub_ps(one, sa);
+			const __m128 oneMinusBa = _mm_sub_ps(one, ba);
+			const __m128 oa = _mm_add_ps(sa, _mm_mul_ps(ba, oneMinusSa));
+			const __m128 destRate = _mm_mul_ps(oneMinusSa, ba);
+
+			// 除算は 4 画素で 1 回にまとめる (透明な画素の 0 除算の結果は下で捨てる)
+			const __m128 scale = _mm_div_ps(_mm_set1_ps(255.0f), oa);
+			__m128i result = storeChannelSSE2(_mm_mul_ps(oa, _mm_set1_ps(255.0f)), 24);
+			for (const int shift : {0, 8, 16})
+			{
+				const __m128 cs = loadChannelSSE2(srcPixels, shift);
+				const __m128 cb = loadChannelSSE2(destPixels, shift);
+				const __m128 mixed = _mm_add_ps(
+					_mm_mul_ps(oneMinusBa, cs), _mm_mul_ps(ba, blendChannelSSE2<BlendMode>(cb, cs)));
+				const __m128 premultiplied = _mm_add_ps(_mm_mul_ps(sa, mixed), _mm_mul_ps(destRate, cb));
+				result = _mm_or_si128(result, storeChannelSSE2(_mm_mul_ps(premultiplied, scale), shift));
+			}
+
+			const __m128i mask = _mm_castps_si128(visible);
+			result = _mm_or_si128(_mm_and_si128(mask, result), _mm_andnot_si128(mask, destPixels));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), result);
+		}
+
+		blendScalar<BlendMode>(dest + i, src + i, count - i, opacity);
+	}
+#endif
+
+	template <template <PSDBlendMode> class Blender>
+	void dispatchBlendMode(Color* dest, const Color* src, size_t count, PSDBlendMode blendMode, uint8 opacity)
+	{
+		switch (blendMode)
+		{
+		case PSDBlendMode::Multiply:
+			Blender<PSDBlendMode::Multiply>::Run(dest, src, count, opacity);
+			return;
+		case PSDBlendMode::Screen:
+			Blender<PSDBlendMode::Screen>::Run(dest, src, count, opacity);
+			return;
+		case PSDBlendMode::Overlay:
+			Blender<PSDBlendMode::Overlay>::Run(dest, src, count, opacity);
+			return;
+		case PSDBlendMode::Add:
+			Blender<PSDBlendMode::Add>::Run(dest, src, count, opacity);
+			return;
+		default:
+			Blender<PSDBlendMode::Normal>::Run(dest, src, count, opacity);
+			return;
+		}
+	}
+
+	template <PSDBlendMode BlendMode>
+	struct ScalarBlender
+	{
+		static void Run(Color* dest, const Color* src, size_t count, uint8 opacity)
+		{
+			blendScalar<BlendMode>(dest, src, count, opacity);
+		}
+	};
+
+#if SIVPSD_KERNEL_X64
+	template <PSDBlendMode BlendMode>
+	struct SSE2Blender
+	{
+		static void Run(Color* dest, const Color* src, size_t count, uint8 opacity)
+		{
+			blendSSE2<BlendMode>(dest, src, count, opacity);
+		}
+	};
+#endif
+
+	size_t findFirstAlphaScalar(const Color* src, size_t count)
+	{
+		size_t i = 0;
+		while (i < count && src[i].a == 0) ++i;
+		return i;
+	}
+
+	size_t findLastAlphaScalar(const Color* src, size_t count)
+	{
+		while (count > 0 && src[count - 1].a == 0) --count;
+		return count;
+	}
+
+#if SIVPSD_KERNEL_X64
+	/// @brief 16 画素のアルファがすべて 0 か
+	bool isTransparent16SSE2(const Color* src)
+	{
+		const auto p = reinterpret_cast<const __m128i*>(src);
+		const __m128i bits = _mm_or_si128(
+			_mm_or_si128(_mm_loadu_si128(p + 0), _mm_loadu_si128(p + 1)),
+			_mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+		const __m128i alpha = _mm_and_si128(bits, _mm_set1_epi32(static_cast<int>(0xFF000000u)));
+		return _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) == 0xFFFF;
+	}
+
+	// 透明な 16 画素をまとめて読み飛ばし、見つかった 16 画素の中はスカラーで調べる
+	size_t findFirstAlphaSSE2(const Color* src, size_t count)
+	{
+		size_t i = 0;
+		while (i + 16 <= count && isTransparent16SSE2(src + i)) i += 16;
+		return i + findFirstAlphaScalar(src + i, count - i);
+	}
+
+	size_t findLastAlphaSSE2(const Color* src, size_t count)
+	{
+		while (count >= 16 && isTransparent16SSE2(src + count - 16)) count -= 16;
+		return findLastAlphaScalar(src, count);
+	}
+#endif
+
+	constexpr uint64 HashPrime1 = 11400714785074694791ULL;
+	constexpr uint64 HashPrime2 = 14029467366897019727ULL;
+	constexpr uint64 HashPrime3 = 1609587929392839161ULL;
+	constexpr uint64 HashPrime4 = 9650029242287828579ULL;
+	constexpr uint64 HashPrime5 = 2870177450012600261ULL;
+
+	uint64 rotl64(uint64 x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	template <class T>
+	T readUnaligned(const uint8* p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	uint64 hashRound(uint64 acc, uint64 input)
+	{
+		acc += input * HashPrime2;
+		return rotl64(acc, 31) * HashPrime1;
+	}
+
+	uint64 hashMergeRound(uint64 acc, uint64 value)
+	{
+		acc ^= hashRound(0, value);
+		return acc * HashPrime1 + HashPrime4;
+	}
+
+	InstructionSet detectInstructionSet()
+	{
+#if SIVPSD_KERNEL_X64
+		// x64 では SSE2 が常に利用可能
+		return hasAVX2() ? InstructionSet::AVX2 : InstructionSet::SSE2;
+#else
+		return InstructionSet::Scalar;
+#endif
+	}
+}
+
+namespace SivPSD::Kernel
+{
+	InstructionSet GetInstructionSet() noexcept
+	{
+		static const InstructionSet instructionSet = detectInstructionSet();
+		return instructionSet;
+	}
+
+	StringView ToString(InstructionSet instructionSet) noexcept
+	{
+		switch (instructionSet)
+		{
+		case InstructionSet::Scalar:
+			return U"Scalar"_sv;
+		case InstructionSet::SSE2:
+			return U"SSE2"_sv;
+		case InstructionSet::AVX2:
+			return U"AVX2"_sv;
+		default:
+			return U""_sv;
+		}
+	}
+
+	void InterleaveRGBA(
+		const uint8* srcR, const uint8* srcG, const uint8* srcB, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		InterleaveRGBA(srcR, srcG, srcB, srcA, dest, count, GetInstructionSet());
+	}
+
+	void InterleaveRGBA(
+		const uint8* srcR, const uint8* srcG, const uint8* srcB, const uint8* srcA,
+		Color* dest, size_t count, InstructionSet instructionSet)
+	{
+		switch (instructionSet)
+		{
+#if SIVPSD_KERNEL_X64
+		case InstructionSet::AVX2:
+			interleaveAVX2(srcR, srcG, srcB, srcA, dest, count);
+			return;
+		case InstructionSet::SSE2:
+			interleaveSSE2(srcR, srcG, srcB, srcA, dest, count);
+			return;
+#endif
+		default:
+			interleaveScalar(srcR, srcG, srcB, srcA, dest, count);
+			return;
+		}
+	}
+
+	void BlendRow(Color* dest, const Color* src, size_t count, PSDBlendMode blendMode, uint8 opacity)
+	{
+		BlendRow(dest, src, count, blendMode, opacity, GetInstructionSet());
+	}
+
+	void BlendRow(
+		Color* dest, const Color* src, size_t count, PSDBlendMode blendMode, uint8 opacity,
+		InstructionSet instructionSet)
+	{
+		if (opacity == 0) return;
+
+#if SIVPSD_KERNEL_X64
+		// 合成は演算が律速のため AVX2 でも SSE2 の実装を使う
+		if (instructionSet != InstructionSet::Scalar)
+		{
+			dispatchBlendMode<SSE2Blender>(dest, src, count, blendMode, opacity);
+			return;
+		}
+#endif
+		dispatchBlendMode<ScalarBlender>(dest, src, count, blendMode, opacity);
+	}
+
+	uint64 Hash64(const void* data, size_t size, uint64 seed) noexcept
+	{
+		const uint8* p = static_cast<const uint8*>(data);
+		const uint8* const end = p + size;
+
+		uint64 h;
+		if (size >= 32)
+		{
+			// 独立した 4 レーンで 32 バイトずつ処理する
+			uint64 v1 = seed + HashPrime1 + HashPrime2;
+			uint64 v2 = seed + HashPrime2;
+			uint64 v3 = seed;
+			uint64 v4 = seed - HashPrime1;
+			for (; p + 32 <= end; p += 32)
+			{
+				v1 = hashRound(v1, readUnaligned<uint64>(p));
+				v2 = hashRound(v2, readUnaligned<uint64>(p + 8));
+				v3 = hashRound(v3, readUnaligned<uint64>(p + 16));
+				v4 = hashRound(v4, readUnaligned<uint64>(p + 24));
+			}
+			h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+			h = hashMergeRound(h, v1);
+			h = hashMergeRound(h, v2);
+			h = hashMergeRound(h, v3);
+			h = hashMergeRound(h, v4);
+		}
+		else
+		{
+			h = seed + HashPrime5;
+		}
+
+		h += size;
+		for (; p + 8 <= end; p += 8)
+		{
+			h ^= hashRound(0, readUnaligned<uint64>(p));
+			h = rotl64(h, 27) * HashPrime1 + HashPrime4;
+		}
+		if (p + 4 <= end)
+		{
+			h ^= readUnaligned<uint32>(p) * HashPrime1;
+			h = rotl64(h, 23) * HashPrime2 + HashPrime3;
+			p += 4;
+		}
+		for (; p < end; ++p)
+		{
+			h ^= *p * HashPrime5;
+			h = rotl64(h, 11) * HashPrime1;
+		}
+
+		h ^= h >> 33;
+		h *= HashPrime2;
+		h ^= h >> 29;
+		h *= HashPrime3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	void InterleaveGray(const uint8* srcGray, const uint8* srcA, Color* dest, size_t count)
+	{
+#if SIVPSD_KERNEL_X64
+		interleaveGraySSE2(srcGray, srcA, dest, count);
+#else
+		interleaveGrayScalar(srcGray, srcA, dest, count);
+#endif
+	}
+
+	void InterleaveCMYK(
+		const uint8* srcC, const uint8* srcM, const uint8* srcY, const uint8* srcK, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+#if SIVPSD_KERNEL_X64
+		interleaveCMYKSSE2(srcC, srcM, srcY, srcK, srcA, dest, count);
+#else
+		interleaveCMYKScalar(srcC, srcM, srcY, srcK, srcA, dest, count);
+#endif
+	}
+
+	void InterleaveLab(
+		const uint8* srcL, const uint8* srcLabA, const uint8* srcLabB, const uint8* srcA,
+		Color* dest, size_t count)
+	{
+		InterleaveLab(srcL, srcLabA, srcLabB, srcA, dest, count, GetInstructionSet());
+	}
+
+	void InterleaveLab(
+		const uint8* srcL, const uint8* srcLabA, const uint8* srcLabB, const uint8* srcA,
+		Color* dest, size_t count, InstructionSet instructionSet)
+	{
+		switch (instructionSet)
+		{
+#if SIVPSD_KERNEL_X64
+		case InstructionSet::AVX2:
+			interleaveLabAVX2(srcL, srcLabA, srcLabB, srcA, dest, count);
+			return;
+		case InstructionSet::SSE2:
+			interleaveLabSSE2(srcL, srcLabA, srcLabB, srcA, dest, count);
+			return;
+#endif
+		default:
+			interleaveLabScalar(srcL, srcLabA, srcLabB, srcA, dest, count);
+			return;
+		}
+	}
+
+	void MultiplyAlpha(Color* dest, const uint8* mask, size_t count)
+	{
+#if SIVPSD_KERNEL_X64
+		multiplyAlphaSSE2(dest, mask, count);
+#else
+		multiplyAlphaScalar(dest, mask, count);
+#endif
+	}
+
+	void MultiplyAlpha(Color* dest, uint8 value, size_t count)
+	{
+		if (value == 255) return;
+
+		// 一定の値を並べたマスクとして処理する
+		std::array<uint8, 256> mask;
+		mask.fill(value);
+		for (size_t i = 0; i < count; i += mask.size())
+		{
+			MultiplyAlpha(dest + i, mask.data(), Min(mask.size(), count - i));
+		}
+	}
+
+	void MultiplyAlpha(Color* dest, const Color* src, size_t count)
+	{
+#if SIVPSD_KERNEL_X64
+		multiplyAlphaSSE2(dest, src, count);
+#else
+		multiplyAlphaScalar(dest, src, count);
+#endif
+	}
+
+	void InterleaveRGBA(
+		const uint16* srcR, const uint16* srcG, const uint16* srcB, const uint16* srcA,
+		Color* dest, size_t count, Optional<int32> ditherRow)
+	{
+		const auto thresholds = getDitherThresholds16(ditherRow);
+#if SIVPSD_KERNEL_X64
+		interleave16SSE2(srcR, srcG, srcB, srcA, dest, count, thresholds);
+#else
+		interleave16Scalar(srcR, srcG, srcB, srcA, dest, count, 0, thresholds);
+#endif
+	}
+
+	void InterleaveRGBA(
+		const float* srcR, const float* srcG, const float* srcB, const float* srcA,
+		Color* dest, size_t count, Optional<int32> ditherRow)
+	{
+		const auto thresholds = getDitherThresholdsFloat(ditherRow);
+#if SIVPSD_KERNEL_X64
+		interleaveFloatSSE2(srcR, srcG, srcB, srcA, dest, count, thresholds);
+#else
+		interleaveFloatScalar(srcR, srcG, srcB, srcA, dest, count, 0, thresholds);
+#endif
+	}
+
+	void InterleaveRGBA(
+		const uint16* srcR, const uint16* srcG, const uint16* srcB, const uint16* srcA,
+		Float4* dest, size_t count)
+	{
+#if SIVPSD_KERNEL_X64
+		interleaveToFloat4SSE2(srcR, srcG, srcB, srcA, dest, count);
+#else
+		interleaveToFloat4Scalar(srcR, srcG, srcB, srcA, dest, count);
+#endif
+	}
+
+	void InterleaveRGBA(
+		const float* srcR, const float* srcG, const float* srcB, const float* srcA,
+		Float4* dest, size_t count)
+	{
+#if SIVPSD_KERNEL_X64
+		interleaveToFloat4SSE2(srcR, srcG, srcB, srcA, dest, count);
+#else
+		interleaveToFloat4Scalar(srcR, srcG, srcB, srcA, dest, count);
+#endif
+	}
+
+	size_t FindFirstAlpha(const Color* src, size_t count) noexcept
+	{
+#if SIVPSD_KERNEL_X64
+		return findFirstAlphaSSE2(src, count);
+#else
+		return findFirstAlphaScalar(src, count);
+#endif
+	}
+
+	size_t FindLastAlpha(const Color* src, size_t count) noexcept
+	{
+#if SIVPSD_KERNEL_X64
+		return findLastAlphaSSE2(src, count);
+#else
+		return findLastAlphaScalar(src, count);
+#endif
+	}
+
+	Optional<Rect> FindAlphaBounds(const Color* src, Size size, size_t stride) noexcept
+	{
+		const size_t width = static_cast<size_t>(Max(size.x, 0));
+		const auto row = [&](int32 y) { return src + y * stride; };
+
+		// 上下の透明な行を除く
+		int32 top = 0;
+		size_t left = width;
+		for (; top < size.y; ++top)
+		{
+			left = FindFirstAlpha(row(top), width);
+			if (left < width) break;
+		}
+		if (top >= size.y) return none;
+
+		int32 bottom = size.y;
+		while (FindLastAlpha(row(bottom - 1), width) == 0) --bottom;
+
+		// 左右は、これまでに見つかった範囲の外側だけを調べて広げる
+		size_t right = FindLastAlpha(row(top), width);
+		for (int32 y = top + 1; y < bottom && (left > 0 || right < width); ++y)
+		{
+			left = FindFirstAlpha(row(y), left);
+			right += FindLastAlpha(row(y) + right, width - right);
+		}
+		return Rect{static_cast<int32>(left), top, static_cast<int32>(right - left), bottom - top};
+	}
+
+	void SwapBytes(uint16* data, size_t count) noexcept
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			data[i] = static_cast<uint16>((data[i] << 8) | (data[i] >> 8));
+		}
+	}
+
+	void SwapBytes(uint32* data, size_t count) noexcept
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const uint32 v = data[i];
+			data[i] = (v << 24) | ((v << 8) & 0x00FF0000u) | ((v >> 8) & 0x0000FF00u) | (v >> 24);
+		}
+	}
+}
@@ -0,0 +1,110 @@
+﻿#pragma once
+#include "PSDObject.h"
+
+namespace SivPSD::Kernel
+{
+	/// @brief カーネルが使用する命令セット
+	enum class InstructionSet
+	{
+		Scalar,
+		SSE2,
+		AVX2,
+	};
+
+	/// @brief 実行環境で利用可能な最上位の命令セット (初回呼び出し時に判定されます)
+	[[nodiscard]]
+	InstructionSet GetInstructionSet() noexcept;
+
+	[[nodiscard]]
+	StringView ToString(InstructionSet instructionSet) noexcept;
+
+	/// @brief 平面の R, G, B, A チャンネルを Color 配列にインターリーブ
+	void InterleaveRGBA(
+		const uint8* srcR, const uint8* srcG, const uint8* srcB, const uint8* srcA,
+		Color* dest, size_t count);
+
+	/// @brief 命令セットを指定してインターリーブ (ベンチマーク用, 実行環境が対応していない命令セットは指定しないでください)
+	void InterleaveRGBA(
+		const uint8* srcR, const uint8* srcG, const uint8* srcB, const uint8* srcA,
+		Color* dest, size_t count, InstructionSet instructionSet);
+
+	/// @brief グレースケールとアルファのチャンネルを Color 配列にインターリーブ
+	void InterleaveGray(const uint8* srcGray, const uint8* srcA, Color* dest, size_t count);
+
+	/// @brief CMYK とアルファのチャンネルを RGB に変換しながらインターリーブ (PSD の CMYK は 255 がインクなし)
+	void InterleaveCMYK(
+		const uint8* srcC, const uint8* srcM, const uint8* srcY, const uint8* srcK, const uint8* srcA,
+		Color* dest, size_t count);
+
+	/// @brief Lab (D50) とアルファのチャンネルを sRGB に変換しながらインターリーブ
+	void InterleaveLab(
+		const uint8* srcL, const uint8* srcLabA, const uint8* srcLabB, const uint8* srcA,
+		Color* dest, size_t count);
+
+	/// @brief 命令セットを指定して Lab をインターリーブ (ベンチマーク用, 実行環境が対応していない命令セットは指定しないでください)
+	void InterleaveLab(
+		const uint8* srcL, const uint8* srcLabA, const uint8* srcLabB, const uint8* srcA,
+		Color* dest, size_t count, InstructionSet instructionSet);
+
+	/// @brief 16 ビット (ネイティブエンディアン) の R, G, B, A チャンネルを 8 ビットに丸めながらインターリーブ
+	/// @param ditherRow 指定した場合、その行番号と列に応じた 4x4 の順序ディザで丸める
+	void InterleaveRGBA(
+		const uint16* srcR, const uint16* srcG, const uint16* srcB, const uint16* srcA,
+		Color* dest, size_t count, Optional<int32> ditherRow);
+
+	/// @brief 32 ビット浮動小数点 (リニア) の R, G, B, A チャンネルを 8 ビット sRGB に変換しながらインターリーブ
+	/// @param ditherRow 指定した場合、その行番号と列に応じた 4x4 の順序ディザで丸める
+	void InterleaveRGBA(
+		const float* srcR, const float* srcG, const float* srcB, const float* srcA,
+		Color* dest, size_t count, Optional<int32> ditherRow);
+
+	/// @brief 16 ビットの R, G, B, A チャンネルを [0, 1] の浮動小数点にしてインターリーブ
+	void InterleaveRGBA(
+		const uint16* srcR, const uint16* srcG, const uint16* srcB, const uint16* srcA,
+		Float4* dest, size_t count);
+
+	/// @brief 32 ビット浮動小数点の R, G, B, A チャンネルをそのままインターリーブ
+	void InterleaveRGBA(
+		const float* srcR, const float* srcG, const float* srcB, const float* srcA,
+		Float4* dest, size_t count);
+
+	/// @brief dest のアルファに mask / 255 を乗算
+	void MultiplyAlpha(Color* dest, const uint8* mask, size_t count);
+
+	/// @brief dest のアルファに value / 255 を乗算
+	void MultiplyAlpha(Color* dest, uint8 value, size_t count);
+
+	/// @brief dest のアルファに src のアルファ / 255 を乗算
+	void MultiplyAlpha(Color* dest, const Color* src, size_t count);
+
+	/// @brief アルファが 0 でない最初の画素の位置 (すべて透明な場合は count)
+	[[nodiscard]]
+	size_t FindFirstAlpha(const Color* src, size_t count) noexcept;
+
+	/// @brief アルファが 0 でない最後の画素の次の位置 (すべて透明な場合は 0)
+	[[nodiscard]]
+	size_t FindLastAlpha(const Color* src, size_t count) noexcept;
+
+	/// @brief アルファが 0 でない画素を囲む最小の矩形 (すべて透明な場合は none)
+	/// @param stride 行の先頭同士の画素数
+	[[nodiscard]]
+	Optional<Rect> FindAlphaBounds(const Color* src, Size size, size_t stride) noexcept;
+
+	/// @brief ビッグエンディアンの値をネイティブエンディアンに変換
+	void SwapBytes(uint16* data, size_t count) noexcept;
+
+	void SwapBytes(uint32* data, size_t count) noexcept;
+
+	/// @brief src を dest の上に合成 (いずれもストレートアルファ)
+	/// @param opacity src 全体に乗算する不透明度
+	void BlendRow(Color* dest, const Color* src, size_t count, PSDBlendMode blendMode, uint8 opacity);
+
+	/// @brief 命令セットを指定して合成 (ベンチマーク用)
+	void BlendRow(
+		Color* dest, const Color* src, size_t count, PSDBlendMode blendMode, uint8 opacity,
+		InstructionSet instructionSet);
+
+	/// @brief バイト列の 64 ビットハッシュ (xxHash64 互換)
+	[[nodiscard]]
+	uint64 Hash64(const void* data, size_t size, uint64 seed = 0) noexcept;
+}
@@ -0,0 +1,156 @@
+﻿#include "stdafx.h"
+#include "PSDMappedFile.h"
+
+#if SIV3D_PLATFORM(WINDOWS)
+#include <Siv3D/Windows/Windows.hpp>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// 同期読み込みなので、完了済みを表す値を返す
+	void* const completedOperation = reinterpret_cast<void*>(1);
+}
+
+namespace SivPSD
+{
+	MappedFile::MappedFile(psd::Allocator* allocator) : File(allocator)
+	{
+	}
+
+	MappedFile::~MappedFile()
+	{
+		DoClose();
+	}
+
+	const uint8* MappedFile::data() const noexcept
+	{
+		return m_data;
+	}
+
+	uint64 MappedFile::size() const noexcept
+	{
+		return m_size;
+	}
+
+#if SIV3D_PLATFORM(WINDOWS)
+	bool MappedFile::DoOpenRead(const wchar_t* filename)
+	{
+		// 開いている間もエディタが上書き保存 (一時ファイルからの置き換えや削除) できるように共有する
+		// マップ中のファイルは切り詰められない (SetEndOfFile が失敗する) ため、マップ済み領域の外を読むことはない
+		const HANDLE file = ::CreateFileW(
+			filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		m_fileHandle = file;
+
+		LARGE_INTEGER fileSize{};
+		if (not ::GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			DoClose();
+			return false;
+		}
+		m_size = static_cast<uint64>(fileSize.QuadPart);
+
+		m_mappingHandle = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mappingHandle == nullptr)
+		{
+			DoClose();
+			return false;
+		}
+
+		m_data = static_cast<const uint8*>(::MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+		if (m_data == nullptr)
+		{
+			DoClose();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool MappedFile::DoClose()
+	{
+		if (m_data) ::UnmapViewOfFile(m_data);
+		if (m_mappingHandle) ::CloseHandle(m_mappingHandle);
+		if (m_fileHandle) ::CloseHandle(m_fileHandle);
+		m_data = nullptr;
+		m_mappingHandle = nullptr;
+		m_fileHandle = nullptr;
+		m_size = 0;
+		return true;
+	}
+#else
+	bool MappedFile::DoOpenRead(const wchar_t* filename)
+	{
+		const std::string path = Unicode::ToUTF8(Unicode::FromWstring(filename));
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat status{};
+		if (::fstat(fd, &status) != 0 || status.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		void* mapped = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+		// マップ後はファイル記述子が不要
+		::close(fd);
+		if (mapped == MAP_FAILED) return false;
+
+		// レイヤーは先頭から順に読まれていくため、先読みを促す
+		::madvise(mapped, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+		::madvise(mapped, static_cast<size_t>(status.st_size), MADV_WILLNEED);
+
+		m_data = static_cast<const uint8*>(mapped);
+		m_size = static_cast<uint64>(status.st_size);
+		return true;
+	}
+
+	bool MappedFile::DoClose()
+	{
+		if (m_data) ::munmap(const_cast<uint8*>(m_data), static_cast<size_t>(m_size));
+		m_data = nullptr;
+		m_size = 0;
+		return true;
+	}
+#endif
+
+	bool MappedFile::DoOpenWrite(const wchar_t*)
+	{
+		return false;
+	}
+
+	psd::File::ReadOperation MappedFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+	{
+		if (position + count > m_size) return nullptr;
+		std::memcpy(buffer, m_data + position, count);
+		return completedOperation;
+	}
+
+	bool MappedFile::DoWaitForRead(ReadOperation& operation)
+	{
+		return operation == completedOperation;
+	}
+
+	psd::File::WriteOperation MappedFile::DoWrite(const void*, uint32_t, uint64_t)
+	{
+		return nullptr;
+	}
+
+	bool MappedFile::DoWaitForWrite(WriteOperation&)
+	{
+		return false;
+	}
+
+	uint64_t MappedFile::DoGetSize() const
+	{
+		return m_size;
+	}
+}
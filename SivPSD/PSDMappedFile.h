@@ -0,0 +1,46 @@
+﻿#pragma once
+#include "Psd/Psd.h"
+#include "Psd/PsdFile.h"
+
+namespace SivPSD
+{
+	/// @brief psd::File の読み込み専用メモリマップ実装
+	/// @remark Read はマップ済み領域からのコピーのみで、システムコールやロックを伴わないため複数スレッドから同時に呼び出せます
+	/// @remark 開いている間も他のプロセスはファイルを置き換え・削除できます (置き換えられた場合は開いた時点の内容を読み続けます)
+	class MappedFile final : public psd::File
+	{
+	public:
+		explicit MappedFile(psd::Allocator* allocator);
+
+		~MappedFile() override;
+
+		MappedFile(const MappedFile&) = delete;
+
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/// @brief マップされたファイルの先頭 (開いていない場合は nullptr)
+		[[nodiscard]]
+		const uint8* data() const noexcept;
+
+		/// @brief マップされたファイルのバイト数
+		[[nodiscard]]
+		uint64 size() const noexcept;
+
+	private:
+		bool DoOpenRead(const wchar_t* filename) override;
+		bool DoOpenWrite(const wchar_t* filename) override;
+		bool DoClose() override;
+		ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) override;
+		bool DoWaitForRead(ReadOperation& operation) override;
+		WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) override;
+		bool DoWaitForWrite(WriteOperation& operation) override;
+		uint64_t DoGetSize() const override;
+
+		const uint8* m_data{};
+		uint64 m_size{};
+#if SIV3D_PLATFORM(WINDOWS)
+		void* m_fileHandle{};
+		void* m_mappingHandle{};
+#endif
+	};
+}
@@ -1,5 +1,6 @@
 ﻿#include "stdafx.h"
 #include "PSDObject.h"
+#include "PSDCompositor.h"
 
 namespace SivPSD
 {
@@ -41,7 +42,12 @@ namespace SivPSD
 
 	bool PSDLayer::isDrawable() const
 	{
-		return isVisible && not texture.isEmpty() && not isFolder;
+		return isVisible && (not texture.isEmpty() || hasAtlasRegion()) && not isFolder;
+	}
+
+	bool PSDLayer::hasAtlasRegion() const
+	{
+		return not atlasRegion.texture.isEmpty();
 	}
 
 	Point PSDLayer::tl() const
@@ -49,6 +55,11 @@ namespace SivPSD
 		return region.tl();
 	}
 
+	Size PSDLayer::imageSize() const
+	{
+		return image.isEmpty() ? compressedImage.size() : image.size();
+	}
+
 	String PSDObject::concatLayerErrors() const
 	{
 		String error{};
@@ -73,11 +84,20 @@ namespace SivPSD
 		return errors;
 	}
 
+	bool PSDObject::isHiddenByClipping(const PSDLayer& layer) const
+	{
+		return layer.clippingBaseId && not layers[*layer.clippingBaseId].isVisible;
+	}
+
 	const PSDObject& PSDObject::draw(const Vec2& pos) const
 	{
 		for (auto&& layer : layers)
 		{
-			if (layer.isDrawable()) (void)layer.texture.draw(layer.tl());
+			if (not layer.isDrawable() || isHiddenByClipping(layer)) continue;
+
+			// 同じページのレイヤーが続く間はテクスチャが切り替わらないため、描画がまとめられる
+			if (layer.hasAtlasRegion()) (void)layer.atlasRegion.draw(layer.tl());
+			else (void)layer.texture.draw(layer.tl());
 		}
 		return *this;
 	}
@@ -86,8 +106,16 @@ namespace SivPSD
 	{
 		for (auto&& layer : layers)
 		{
-			if (layer.isDrawable()) (void)layer.texture.drawAt(pos);
+			if (not layer.isDrawable() || isHiddenByClipping(layer)) continue;
+
+			if (layer.hasAtlasRegion()) (void)layer.atlasRegion.drawAt(pos);
+			else (void)layer.texture.drawAt(pos);
 		}
 		return *this;
 	}
+
+	Image PSDObject::composite() const
+	{
+		return PSDCompositor{}.composite(*this);
+	}
 }
@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include "PSDCompressedImage.h"
 
 namespace SivPSD
 {
@@ -11,6 +12,21 @@ namespace SivPSD
 		StringView type() const noexcept override;
 	};
 
+	/// @brief レイヤーの合成モード
+	enum class PSDBlendMode
+	{
+		/// @brief 通過 (フォルダのみ)
+		PassThrough,
+		Normal,
+		Multiply,
+		Screen,
+		Overlay,
+		/// @brief 加算 (覆い焼き (リニア))
+		Add,
+		/// @brief 上記以外 (合成時は Normal として扱います)
+		Unsupported,
+	};
+
 	/// @brief PSDレイヤー情報
 	struct PSDLayer
 	{
@@ -31,24 +47,56 @@ namespace SivPSD
 		/// @brief 表示フラグ
 		bool isVisible{};
 
+		/// @brief 不透明度
+		uint8 opacity = 255;
+
+		/// @brief 合成モード
+		PSDBlendMode blendMode = PSDBlendMode::Normal;
+
+		/// @brief クリッピングマスクの土台のレイヤーID (土台が非表示の場合、このレイヤーも描画されません)
+		Optional<id_type> clippingBaseId{};
+
 		/// @brief ドキュメント内レイヤー領域
 		Rect region{};
 
 		/// @brief アクセス可能画素配列 (読み込み時の設定によっては空になります)
 		Image image{};
 
+		/// @brief StoreTarget::CompressedImage で読み込んだ場合の、行ごとに圧縮された画素配列 (読み込み時の設定によっては空になります)
+		CompressedImage compressedImage{};
+
+		/// @brief 16/32 ビットのドキュメントで精度を保った画素配列 (ストレートアルファ。16 ビットは [0, 1], 32 ビットはリニアの値のまま。読み込み時の設定によっては空になります)
+		Grid<Float4> floatImage{};
+
 		/// @brief image から作られたテクスチャ (読み込み時の設定によっては空になります)
 		DynamicTexture texture{};
 
+		/// @brief アトラスページ内の領域 (StoreTarget::AtlasTexture などで読み込んだ場合のみ。ページに収まらないレイヤーは texture を持ちます)
+		TextureRegion atlasRegion{};
+
+		/// @brief すべての画素が透明なため、画像とテクスチャを持たないか (trimTransparent を有効にして読み込んだ場合のみ)
+		bool isBlank{};
+
+		/// @brief 画素が同じため、テクスチャまたはアトラス領域を共有しているレイヤーのID (deduplicateLayers を有効にして読み込んだ場合のみ)
+		Optional<id_type> sharedTextureId{};
+
 		/// @brief 読み込み時などで発生したエラー
 		Optional<PSDError> error{};
 
-		/// @brief isVisible が true でテクスチャを持ったレイヤーか
+		/// @brief isVisible が true でテクスチャまたはアトラス領域を持ったレイヤーか
 		bool isDrawable() const;
 
+		/// @brief アトラス領域を持っているか
+		[[nodiscard]]
+		bool hasAtlasRegion() const;
+
 		[[nodiscard]]
 		Point tl() const;
 
+		/// @brief image または compressedImage の大きさ (画素配列を持たない場合は 0)
+		[[nodiscard]]
+		Size imageSize() const;
+
 		friend void Formatter(FormatData& formatData, const PSDLayer& layer);
 	};
 
@@ -58,18 +106,29 @@ namespace SivPSD
 		Size documentSize{};
 		Array<PSDLayer> layers{};
 
+		/// @brief レイヤーが詰め込まれたアトラスページ (StoreTarget::AtlasTexture などで読み込んだ場合のみ)
+		Array<Texture> atlasPages{};
+
 		/// @brief レイヤーに含まれているすべてのエラーを統合し文字列にして返します
 		String concatLayerErrors() const;
 
 		/// @brief レイヤーに含まれているすべてのエラーをレイヤーIDとともに配列として返します
 		Array<std::pair<PSDLayer::id_type, PSDError>> getLayerErrors() const;
 
+		/// @brief クリッピングマスクの土台が非表示のため隠れているレイヤーか
+		[[nodiscard]]
+		bool isHiddenByClipping(const PSDLayer& layer) const;
+
 		/// @brief isDrawable() が true のレイヤーを描画
 		const PSDObject& draw(const Vec2& pos = Vec2{}) const;
 
 		/// @brief isDrawable() が true のレイヤーを描画
 		const PSDObject& drawAt(const Vec2& pos = Vec2{}) const;
 
+		/// @brief 表示されているレイヤーを CPU で合成した画像を返します (画素配列を持たないレイヤーは無視されます)
+		[[nodiscard]]
+		Image composite() const;
+
 		friend void Formatter(FormatData& formatData, const PSDObject& obj);
 	};
 }
@@ -0,0 +1,42 @@
+﻿#include "stdafx.h"
+#include "PSDWorkerPool.h"
+#include "PSDImportScheduler.h"
+
+namespace
+{
+	std::mutex globalPoolMutex{};
+	std::shared_ptr<SivPSD::PSDWorkerPool> globalPool{};
+}
+
+namespace SivPSD
+{
+	PSDWorkerPool::PSDWorkerPool(int32 threadCount) :
+		p_impl(std::make_unique<WorkerPool>(threadCount))
+	{
+	}
+
+	PSDWorkerPool::~PSDWorkerPool() = default;
+
+	int32 PSDWorkerPool::threadCount() const noexcept
+	{
+		return p_impl->threadCount();
+	}
+
+	std::shared_ptr<PSDWorkerPool> PSDWorkerPool::Global()
+	{
+		std::lock_guard lock{globalPoolMutex};
+		if (not globalPool) globalPool = std::make_shared<PSDWorkerPool>();
+		return globalPool;
+	}
+
+	void PSDWorkerPool::SetGlobal(std::shared_ptr<PSDWorkerPool> pool)
+	{
+		std::lock_guard lock{globalPoolMutex};
+		globalPool = std::move(pool);
+	}
+
+	WorkerPool& PSDWorkerPool::workers() const noexcept
+	{
+		return *p_impl;
+	}
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+namespace SivPSD
+{
+	class WorkerPool;
+
+	/// @brief 読み込みに使うワーカースレッドのプール (ワーカーは作業用メモリを保持したまま、複数の読み込みで使い回されます)
+	class PSDWorkerPool
+	{
+	public:
+		/// @param threadCount ワーカー数 (0 以下の場合は論理コア数)
+		explicit PSDWorkerPool(int32 threadCount = 0);
+
+		/// @brief 投入済みの読み込みを処理してから終了します
+		~PSDWorkerPool();
+
+		PSDWorkerPool(const PSDWorkerPool&) = delete;
+
+		PSDWorkerPool& operator=(const PSDWorkerPool&) = delete;
+
+		[[nodiscard]]
+		int32 threadCount() const noexcept;
+
+		/// @brief PSDImporter::Config::workerPool を指定しない場合に使われるプール (初回の呼び出しで論理コア数のワーカーを作ります)
+		[[nodiscard]]
+		static std::shared_ptr<PSDWorkerPool> Global();
+
+		/// @brief 既定のプールを置き換えます (読み込み中のものは元のプールで続行します)
+		static void SetGlobal(std::shared_ptr<PSDWorkerPool> pool);
+
+		/// @brief 内部で使うスレッドプール
+		[[nodiscard]]
+		WorkerPool& workers() const noexcept;
+
+	private:
+		std::unique_ptr<WorkerPool> p_impl;
+	};
+}
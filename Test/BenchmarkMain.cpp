@@ -0,0 +1,11 @@
+﻿// BenchmarkMain.cpp
+
+// CMake の SivPSDBenchmark 用のエントリーポイント (Main4.cpp の読み込みベンチマークのみを実行します)
+
+void Main4();
+
+// Entry point
+void Main()
+{
+	Main4();
+}
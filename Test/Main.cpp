@@ -4,8 +4,19 @@ void Main1();
 
 void Main2();
 
+void Main3();
+
+void Main4();
+
 // Entry point
 void Main()
 {
+	// ヘッドレスの読み込みベンチマーク
+	if (System::GetCommandLineArgs().includes(U"--benchmark"))
+	{
+		Main4();
+		return;
+	}
+
 	Main1();
 }
@@ -35,8 +35,8 @@ void Main1()
 	// PSD読み込みオブジェクトを作成
 	PSDImporter psdImporter{U"psd/miko15.psd"};
 
-	// 読み込みオブジェクトを格納
-	PSDObject psdObject = psdImporter.getObject();
+	// 読み込みオブジェクトを複製せずに取り出す
+	PSDObject psdObject = psdImporter.takeObject();
 
 	writePsdSummary(psdImporter, psdObject, sw);
 
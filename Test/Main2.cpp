@@ -37,15 +37,18 @@ void Main2()
 			.maxThreads = 4,
 			.asyncStart = true,
 			.marginRemove = true,
+			.watchFile = true,
+			.decodePreview = true,
 		}
 	};
 
-	// 読み込みオブジェクト格納先
-	PSDObject psdObject{};
+	// 読み込みオブジェクト格納先 (再読み込み中も直前のオブジェクトを複製せずに保持する)
+	std::shared_ptr<const PSDObject> psdObject = std::make_shared<const PSDObject>();
 
 	Camera2D camera2D{};
 
 	bool loading = true; // 読み込み中
+	bool reloading = false; // ファイルの変更を検出して再読み込み中
 	bool showAll = true; // 全レイヤー表示
 	double layerCursor{}; // 全レイヤー表示じゃないときに表示するレイヤーのカーソル
 
@@ -56,38 +59,67 @@ void Main2()
 			// 読込中...
 			if (not psdImporter.isReady())
 			{
-				// まだ読み込んでない
-				SimpleGUI::Headline(U"Loading...", Vec2{0, 50});
+				// 進捗を表示
+				const auto progress = psdImporter.getProgress();
+				SimpleGUI::Headline(U"Loading... {} / {}"_fmt(progress.completed, progress.total), Vec2{0, 50});
+				const RectF progressBar{0, 100, 300, 20};
+				progressBar.draw(ColorF{0.2});
+				RectF{progressBar.pos, progressBar.w * progress.rate(), progressBar.h}.draw(Palette::Skyblue);
+
+				// 統合画像のプレビューを下に敷く
+				if (psdImporter.isPreviewReady()) (void)psdImporter.getPreviewTexture().draw();
+
+				// 読み込みが完了したレイヤーから描画
+				for (int id = 0; id < progress.total; ++id)
+				{
+					if (const auto layer = psdImporter.getLayer(id); layer && layer->isDrawable())
+					{
+						(void)layer->texture.draw(layer->tl());
+					}
+				}
 				continue; // ループ終了
 			}
 
 			// 完了
 			loading = false;
-			psdObject = psdImporter.getObject();
-			writePsdSummary(psdImporter, psdObject, sw);
-			camera2D.jumpTo(Rect(psdObject.documentSize).topCenter().movedBy(0, psdObject.documentSize.y / 4), 0.5);
+			psdObject = psdImporter.getObjectShared();
+			writePsdSummary(psdImporter, *psdObject, sw);
+			camera2D.jumpTo(Rect(psdObject->documentSize).topCenter().movedBy(0, psdObject->documentSize.y / 4), 0.5);
+		}
+
+		// ファイルが保存されたら変更されたレイヤーのみ読み込み直す (完了までは直前のオブジェクトを描画)
+		if (psdImporter.update())
+		{
+			reloading = true;
+			sw.restart();
+		}
+		else if (reloading && psdImporter.isReady())
+		{
+			reloading = false;
+			psdObject = psdImporter.getObjectShared();
+			writePsdSummary(psdImporter, *psdObject, sw);
 		}
 
 		// 全レイヤー表示じゃないときに表示するレイヤーID
 		const auto showingLayer =
-			std::min(static_cast<size_t>(layerCursor * psdObject.layers.size()), (psdObject.layers.size() - 1));
+			std::min(static_cast<size_t>(layerCursor * psdObject->layers.size()), (psdObject->layers.size() - 1));
 
 		camera2D.update();
 		{
 			// PSD描画
 			Transformer2D t{camera2D.createTransformer()};
 
-			Rect(psdObject.documentSize).stretched(1).drawFrame(2, Palette::Black);
+			Rect(psdObject->documentSize).stretched(1).drawFrame(2, Palette::Black);
 
 			if (showAll)
 			{
 				// isDrawable() が true のレイヤーをすべて描画
-				psdObject.draw();
+				psdObject->draw();
 			}
 			else
 			{
 				// レイヤー単体を描画
-				psdObject.layers[showingLayer].texture.draw(psdObject.layers[showingLayer].tl());
+				psdObject->layers[showingLayer].texture.draw(psdObject->layers[showingLayer].tl());
 			}
 		}
 
@@ -95,10 +127,10 @@ void Main2()
 		SimpleGUI::Headline(U"Completed!", Vec2{0, 50});
 		const auto sceneTr = Rect(Scene::Size()).tr();
 		SimpleGUI::CheckBox(showAll, U"Show all", sceneTr.movedBy(-300, 50));
-		if (not showAll && psdObject.layers.size() > 0)
+		if (not showAll && psdObject->layers.size() > 0)
 		{
 			SimpleGUI::Slider(U"Show: {}"_fmt(showingLayer), layerCursor, sceneTr.movedBy(-300, 100), 100, 200);
-			SimpleGUI::Headline(Format(psdObject.layers[showingLayer]), sceneTr.movedBy(-300, 150));
+			SimpleGUI::Headline(Format(psdObject->layers[showingLayer]), sceneTr.movedBy(-300, 150));
 		}
 	}
 }
@@ -0,0 +1,166 @@
+﻿# include <Siv3D.hpp> // Siv3D v0.6.12
+# include "../SivPSD/PSDKernel.h"
+
+# include "Psd/Psd.h"
+# include "Psd/PsdPlatform.h"
+# include "Psd/PsdInterleave.h"
+
+using namespace SivPSD;
+
+namespace
+{
+	constexpr Size benchmarkSize{4096, 4096};
+	constexpr int benchmarkIterations = 10;
+
+	/// @brief 1回あたりの平均処理時間から MPix/s を算出
+	double toMegaPixelsPerSec(double totalSec)
+	{
+		const double pixels = static_cast<double>(benchmarkSize.x) * benchmarkSize.y * benchmarkIterations;
+		return pixels / totalSec / 1000000.0;
+	}
+
+	// psd_sdk のキャンバス全体インターリーブ + Image へのコピー (以前の読み込み経路)
+	double benchmarkPsdSdk(const std::array<Array<uint8>, 5>& planes, Image& image)
+	{
+		Array<Color> colorArray(benchmarkSize.x * benchmarkSize.y);
+		Stopwatch sw{StartImmediately::Yes};
+		for (int i = 0; i < benchmarkIterations; ++i)
+		{
+			psd::imageUtil::InterleaveRGBA(
+				planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data(),
+				reinterpret_cast<uint8_t*>(colorArray.data()),
+				benchmarkSize.x, benchmarkSize.y);
+			std::memcpy(image.data(), colorArray.data(), image.size_bytes());
+		}
+		return sw.sF();
+	}
+
+	// Image へ直接書き込むカーネル
+	double benchmarkKernel(const std::array<Array<uint8>, 5>& planes, Image& image, Kernel::InstructionSet instructionSet)
+	{
+		Stopwatch sw{StartImmediately::Yes};
+		for (int i = 0; i < benchmarkIterations; ++i)
+		{
+			Kernel::InterleaveRGBA(
+				planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data(),
+				image.data(), image.num_pixels(), instructionSet);
+		}
+		return sw.sF();
+	}
+
+	// カラーモードごとの変換付きインターリーブ
+	template <class Interleave>
+	double benchmarkColorMode(Interleave interleave)
+	{
+		Stopwatch sw{StartImmediately::Yes};
+		for (int i = 0; i < benchmarkIterations; ++i) interleave();
+		return sw.sF();
+	}
+
+	// 同じ下地に同じレイヤーを重ねる合成
+	double benchmarkBlend(
+		const Image& base, const Image& layer, Image& image, PSDBlendMode blendMode, Kernel::InstructionSet instructionSet)
+	{
+		double sec = 0.0;
+		for (int i = 0; i < benchmarkIterations; ++i)
+		{
+			std::memcpy(image.data(), base.data(), image.size_bytes());
+			Stopwatch sw{StartImmediately::Yes};
+			Kernel::BlendRow(image.data(), layer.data(), image.num_pixels(), blendMode, 192, instructionSet);
+			sec += sw.sF();
+		}
+		return sec;
+	}
+}
+
+void Main3()
+{
+	Window::SetTitle(U"SivPSD Interleave Benchmark");
+
+	std::array<Array<uint8>, 5> planes{};
+	for (auto&& plane : planes)
+	{
+		plane = Array<uint8>::Generate(benchmarkSize.x * benchmarkSize.y, []() { return static_cast<uint8>(Random(255)); });
+	}
+
+	Image image{benchmarkSize};
+
+	Console.writeln(U"Interleave {}x{} x {}"_fmt(benchmarkSize.x, benchmarkSize.y, benchmarkIterations));
+	Console.writeln(U"psd_sdk: {:.1f} MPix/s"_fmt(toMegaPixelsPerSec(benchmarkPsdSdk(planes, image))));
+
+	const Image expected = image;
+	const auto available = Kernel::GetInstructionSet();
+	for (const auto instructionSet : {Kernel::InstructionSet::Scalar, Kernel::InstructionSet::SSE2, Kernel::InstructionSet::AVX2})
+	{
+		if (instructionSet > available) break;
+		const double sec = benchmarkKernel(planes, image, instructionSet);
+		const bool matched = std::memcmp(image.data(), expected.data(), image.size_bytes()) == 0;
+		Console.writeln(U"{}: {:.1f} MPix/s{}"_fmt(
+			Kernel::ToString(instructionSet), toMegaPixelsPerSec(sec), matched ? U""_sv : U" (mismatch)"_sv));
+	}
+
+	// RGB に対する各カラーモードの変換コスト
+	const size_t count = image.num_pixels();
+	const double rgbSec = benchmarkKernel(planes, image, available);
+	const std::array<std::pair<StringView, std::function<void()>>, 3> colorModes{{
+		{U"Grayscale", [&]() { Kernel::InterleaveGray(planes[0].data(), planes[1].data(), image.data(), count); }},
+		{U"CMYK", [&]()
+		{
+			Kernel::InterleaveCMYK(
+				planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data(), planes[4].data(), image.data(), count);
+		}},
+		{U"Lab", [&]()
+		{
+			Kernel::InterleaveLab(planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data(), image.data(), count);
+		}},
+	}};
+	Console.writeln(U"RGB: {:.1f} MPix/s"_fmt(toMegaPixelsPerSec(rgbSec)));
+	for (const auto& [name, interleave] : colorModes)
+	{
+		const double sec = benchmarkColorMode(interleave);
+		Console.writeln(U"{}: {:.1f} MPix/s (x{:.2f} of RGB)"_fmt(name, toMegaPixelsPerSec(sec), sec / rgbSec));
+	}
+
+	// Lab は命令セットごとに、RGB に対する倍率とスカラーの結果と一致するかを確認する
+	const auto interleaveLab = [&](Kernel::InstructionSet instructionSet)
+	{
+		Kernel::InterleaveLab(
+			planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data(), image.data(), count, instructionSet);
+	};
+	interleaveLab(Kernel::InstructionSet::Scalar);
+	const Image expectedLab = image;
+	for (const auto instructionSet : {Kernel::InstructionSet::Scalar, Kernel::InstructionSet::SSE2, Kernel::InstructionSet::AVX2})
+	{
+		if (instructionSet > available) break;
+		const double sec = benchmarkColorMode([&]() { interleaveLab(instructionSet); });
+		const bool matched = std::memcmp(image.data(), expectedLab.data(), image.size_bytes()) == 0;
+		Console.writeln(U"Lab {}: {:.1f} MPix/s (x{:.2f} of RGB){}"_fmt(
+			Kernel::ToString(instructionSet), toMegaPixelsPerSec(sec), sec / rgbSec, matched ? U""_sv : U" (mismatch)"_sv));
+	}
+
+	// 合成モードごとに、スカラーの結果と一致するか確認する
+	const Image base = image;
+	Kernel::InterleaveRGBA(planes[1].data(), planes[2].data(), planes[3].data(), planes[4].data(), image.data(), count);
+	const Image layer = image;
+	const std::array<std::pair<StringView, PSDBlendMode>, 5> blendModes{{
+		{U"Normal", PSDBlendMode::Normal},
+		{U"Multiply", PSDBlendMode::Multiply},
+		{U"Screen", PSDBlendMode::Screen},
+		{U"Overlay", PSDBlendMode::Overlay},
+		{U"Add", PSDBlendMode::Add},
+	}};
+	for (const auto& [name, blendMode] : blendModes)
+	{
+		const double scalarSec = benchmarkBlend(base, layer, image, blendMode, Kernel::InstructionSet::Scalar);
+		const Image expectedBlend = image;
+		const double sec = benchmarkBlend(base, layer, image, blendMode, available);
+		const bool matched = std::memcmp(image.data(), expectedBlend.data(), image.size_bytes()) == 0;
+		Console.writeln(U"Blend {}: Scalar {:.1f} MPix/s, {} {:.1f} MPix/s{}"_fmt(
+			name, toMegaPixelsPerSec(scalarSec), Kernel::ToString(available),
+			toMegaPixelsPerSec(sec), matched ? U""_sv : U" (mismatch)"_sv));
+	}
+
+	while (System::Update())
+	{
+	}
+}
@@ -0,0 +1,562 @@
+﻿# include <Siv3D.hpp> // Siv3D v0.6.12
+# include "../SivPSD/PSDImporter.h"
+
+# if SIV3D_PLATFORM(WINDOWS)
+#	include <Siv3D/Windows/Windows.hpp>
+#	include <Psapi.h>
+# else
+#	include <sys/resource.h>
+# endif
+
+// GPU のない環境で実行する場合は SIVPSD_HEADLESS を定義してビルドし、--benchmark を付けて起動してください
+// Linux ではリポジトリ直下の CMakeLists.txt で SivPSDBenchmark をビルドできます (--benchmark は不要)
+# ifdef SIVPSD_HEADLESS
+SIV3D_SET(EngineOption::Renderer::Headless)
+# endif
+
+using namespace SivPSD;
+
+namespace
+{
+	/// @brief 生成する PSD の条件
+	struct SyntheticPSDSpec
+	{
+		String name;
+		Size canvasSize;
+		int32 layerCount;
+
+		/// @brief レイヤーの大きさの偏り (0 は全レイヤーがキャンバスの 3/4、大きいほど小さなレイヤーが増える)
+		double sizeSkew;
+
+		bool rle;
+		int32 bitsPerChannel;
+	};
+
+	const Array<SyntheticPSDSpec> benchmarkSpecs{
+		{U"base", {2048, 2048}, 64, 1.0, true, 8},
+		{U"many-layers", {2048, 2048}, 512, 1.0, true, 8},
+		{U"large-canvas", {8192, 8192}, 32, 1.0, true, 8},
+		{U"uniform-size", {2048, 2048}, 32, 0.0, true, 8},
+		{U"skewed", {8192, 8192}, 16, 2.0, true, 8},
+		{U"raw", {2048, 2048}, 64, 1.0, false, 8},
+		{U"16-bit", {2048, 2048}, 64, 1.0, true, 16},
+	};
+
+	const Array<int32> benchmarkThreads{1, 2, 4, 8};
+
+	constexpr int benchmarkIterations = 3;
+
+	/// @brief ビッグエンディアンで書き出す
+	class BigEndianWriter
+	{
+	public:
+		explicit BigEndianWriter(const FilePath& path) : m_writer(path)
+		{
+		}
+
+		[[nodiscard]]
+		explicit operator bool() const noexcept
+		{
+			return static_cast<bool>(m_writer);
+		}
+
+		[[nodiscard]]
+		int64 getPos() const
+		{
+			return m_writer.getPos();
+		}
+
+		void bytes(const void* data, size_t size)
+		{
+			(void)m_writer.write(data, static_cast<int64>(size));
+		}
+
+		template <class T>
+		void value(T v)
+		{
+			using U = std::make_unsigned_t<T>;
+			std::array<uint8, sizeof(T)> bytesBE{};
+			for (size_t i = 0; i < sizeof(T); ++i)
+			{
+				bytesBE[i] = static_cast<uint8>(static_cast<U>(v) >> (8 * (sizeof(T) - 1 - i)));
+			}
+			bytes(bytesBE.data(), bytesBE.size());
+		}
+
+		/// @brief 書き出し済みの位置の値を書き換える
+		template <class T>
+		void patch(int64 pos, T v)
+		{
+			const int64 current = m_writer.getPos();
+			(void)m_writer.setPos(pos);
+			value(v);
+			(void)m_writer.setPos(current);
+		}
+
+	private:
+		BinaryWriter m_writer;
+	};
+
+	/// @brief 1行を PackBits で圧縮
+	void packBitsRow(const uint8* src, size_t size, Array<uint8>& dest)
+	{
+		size_t i = 0;
+		while (i < size)
+		{
+			size_t run = 1;
+			while (i + run < size && run < 128 && src[i + run] == src[i]) ++run;
+			if (run >= 3)
+			{
+				dest.push_back(static_cast<uint8>(1 - static_cast<int>(run)));
+				dest.push_back(src[i]);
+				i += run;
+				continue;
+			}
+
+			// 3 バイト以上の繰り返しが始まるまでをそのままコピー
+			size_t literal = 0;
+			while (i + literal < size && literal < 128)
+			{
+				if (i + literal + 2 < size
+					&& src[i + literal] == src[i + literal + 1] && src[i + literal] == src[i + literal + 2])
+				{
+					break;
+				}
+				++literal;
+			}
+			dest.push_back(static_cast<uint8>(literal - 1));
+			dest.insert(dest.end(), src + i, src + i + literal);
+			i += literal;
+		}
+	}
+
+	/// @brief 行ごとのバイト列をチャンネルデータ (圧縮形式 + データ) にする
+	Array<uint8> encodeChannel(const Array<uint8>& rows, size_t rowBytes, int32 rowCount, bool rle)
+	{
+		Array<uint8> data{0, static_cast<uint8>(rle ? 1 : 0)};
+		if (not rle)
+		{
+			data.insert(data.end(), rows.begin(), rows.end());
+			return data;
+		}
+
+		data.resize(2 + rowCount * sizeof(uint16));
+		Array<uint8> packed{};
+		for (int32 y = 0; y < rowCount; ++y)
+		{
+			const size_t before = packed.size();
+			packBitsRow(rows.data() + y * rowBytes, rowBytes, packed);
+			const size_t rowSize = packed.size() - before;
+			data[2 + y * 2] = static_cast<uint8>(rowSize >> 8);
+			data[2 + y * 2 + 1] = static_cast<uint8>(rowSize);
+		}
+		data.insert(data.end(), packed.begin(), packed.end());
+		return data;
+	}
+
+	/// @brief レイヤーの1チャンネル分の画素を作る (赤は横方向のグラデーションに雑音、緑は縦方向、青は一定、アルファは楕円)
+	Array<uint8> makeLayerChannel(int16 channel, int32 layerIndex, Size size, int32 bitsPerChannel)
+	{
+		const size_t bytesPerChannel = bitsPerChannel / 8;
+		Array<uint8> rows(size.x * size.y * bytesPerChannel);
+		uint32 noise = 0x9E3779B9u * (layerIndex + 1);
+		for (int32 y = 0; y < size.y; ++y)
+		{
+			for (int32 x = 0; x < size.x; ++x)
+			{
+				double value;
+				switch (channel)
+				{
+				case 0:
+					noise = noise * 1664525u + 1013904223u;
+					value = static_cast<double>(x) / size.x * 0.95 + (noise >> 24) / 255.0 * 0.05;
+					break;
+				case 1:
+					value = static_cast<double>(y) / size.y;
+					break;
+				case 2:
+					value = (layerIndex * 37 % 256) / 255.0;
+					break;
+				default:
+				{
+					const Vec2 p{(x + 0.5) / size.x * 2 - 1, (y + 0.5) / size.y * 2 - 1};
+					value = p.lengthSq() <= 1.0 ? 1.0 : 0.0;
+				}
+				}
+
+				uint8* dest = rows.data() + (static_cast<size_t>(y) * size.x + x) * bytesPerChannel;
+				if (bytesPerChannel == 1)
+				{
+					dest[0] = static_cast<uint8>(value * 255 + 0.5);
+				}
+				else
+				{
+					const auto v = static_cast<uint16>(value * 65535 + 0.5);
+					dest[0] = static_cast<uint8>(v >> 8);
+					dest[1] = static_cast<uint8>(v);
+				}
+			}
+		}
+		return rows;
+	}
+
+	/// @brief レイヤーの矩形 (乱数は固定のため、同じ条件では同じ矩形になる)
+	Array<Rect> makeLayerRects(const SyntheticPSDSpec& spec)
+	{
+		uint32 seed = 12345;
+		const auto next = [&]()
+		{
+			seed = seed * 1664525u + 1013904223u;
+			return seed >> 8;
+		};
+
+		Array<Rect> rects{};
+		for (int32 i = 0; i < spec.layerCount; ++i)
+		{
+			const double scale = Max(0.05, 0.75 * std::pow(i + 1.0, -spec.sizeSkew));
+			const Size size{
+				Max(1, static_cast<int32>(spec.canvasSize.x * scale)), Max(1, static_cast<int32>(spec.canvasSize.y * scale))
+			};
+			const Point range = spec.canvasSize - size;
+			rects.emplace_back(
+				Point{static_cast<int32>(next() % (range.x + 1)), static_cast<int32>(next() % (range.y + 1))}, size);
+		}
+		return rects;
+	}
+
+	/// @brief 生成した PSD のレイヤーの画素数
+	struct SyntheticPSDInfo
+	{
+		/// @brief 全レイヤーの画素数の合計
+		int64 layerPixels{};
+
+		/// @brief 最も大きいレイヤーの画素数
+		int64 largestLayerPixels{};
+	};
+
+	/// @brief 条件に沿った RGB の PSD を書き出し、レイヤーの画素数を返す
+	Optional<SyntheticPSDInfo> writeSyntheticPSD(const FilePath& path, const SyntheticPSDSpec& spec)
+	{
+		BigEndianWriter writer{path};
+		if (not writer) return none;
+
+		const size_t bytesPerChannel = spec.bitsPerChannel / 8;
+		const Array<Rect> rects = makeLayerRects(spec);
+		constexpr std::array<int16, 4> channelIds{-1, 0, 1, 2};
+
+		// ヘッダ
+		writer.bytes("8BPS", 4);
+		writer.value<uint16>(1);
+		writer.bytes(std::array<uint8, 6>{}.data(), 6);
+		writer.value<uint16>(3);
+		writer.value<uint32>(spec.canvasSize.y);
+		writer.value<uint32>(spec.canvasSize.x);
+		writer.value<uint16>(static_cast<uint16>(spec.bitsPerChannel));
+		writer.value<uint16>(3);
+
+		// カラーモードデータ、画像リソース
+		writer.value<uint32>(0);
+		writer.value<uint32>(0);
+
+		// レイヤーとマスク情報 (長さは後で書き換える)
+		const int64 layerMaskInfoPos = writer.getPos();
+		writer.value<uint32>(0);
+		writer.value<uint32>(0);
+		writer.value<int16>(static_cast<int16>(spec.layerCount));
+
+		// レイヤーレコード (チャンネルデータの長さは後で書き換える)
+		Array<std::array<int64, 4>> channelLengthPos(spec.layerCount);
+		for (int32 i = 0; i < spec.layerCount; ++i)
+		{
+			const Rect& rect = rects[i];
+			writer.value<int32>(rect.y);
+			writer.value<int32>(rect.x);
+			writer.value<int32>(rect.y + rect.h);
+			writer.value<int32>(rect.x + rect.w);
+			writer.value<uint16>(static_cast<uint16>(channelIds.size()));
+			for (size_t c = 0; c < channelIds.size(); ++c)
+			{
+				writer.value<int16>(channelIds[c]);
+				channelLengthPos[i][c] = writer.getPos();
+				writer.value<uint32>(0);
+			}
+			writer.bytes("8BIMnorm", 8);
+			writer.value<uint8>(255);
+			writer.value<uint8>(0);
+			writer.value<uint8>(0);
+			writer.value<uint8>(0);
+
+			// 追加データ: マスクなし、合成範囲なし、4 バイト境界に揃えた名前
+			const std::string name = U"Layer {}"_fmt(i).toUTF8();
+			const size_t nameBytes = (name.size() + 1 + 3) / 4 * 4;
+			writer.value<uint32>(static_cast<uint32>(8 + nameBytes));
+			writer.value<uint32>(0);
+			writer.value<uint32>(0);
+			writer.value<uint8>(static_cast<uint8>(name.size()));
+			writer.bytes(name.data(), name.size());
+			writer.bytes(std::array<uint8, 4>{}.data(), nameBytes - name.size() - 1);
+		}
+
+		// チャンネルデータ
+		SyntheticPSDInfo info{};
+		for (int32 i = 0; i < spec.layerCount; ++i)
+		{
+			const Size size = rects[i].size;
+			info.layerPixels += static_cast<int64>(size.x) * size.y;
+			info.largestLayerPixels = Max(info.largestLayerPixels, static_cast<int64>(size.x) * size.y);
+			for (size_t c = 0; c < channelIds.size(); ++c)
+			{
+				const auto rows = makeLayerChannel(channelIds[c], i, size, spec.bitsPerChannel);
+				const auto data = encodeChannel(rows, size.x * bytesPerChannel, size.y, spec.rle);
+				writer.patch<uint32>(channelLengthPos[i][c], static_cast<uint32>(data.size()));
+				writer.bytes(data.data(), data.size());
+			}
+		}
+
+		// レイヤー情報の長さは偶数に揃える
+		const int64 layerInfoEnd = writer.getPos();
+		if ((layerInfoEnd - layerMaskInfoPos - 8) % 2 != 0) writer.value<uint8>(0);
+		const int64 layerInfoLength = writer.getPos() - layerMaskInfoPos - 8;
+		writer.value<uint32>(0); // グローバルレイヤーマスク
+		writer.patch<uint32>(layerMaskInfoPos, static_cast<uint32>(writer.getPos() - layerMaskInfoPos - 4));
+		writer.patch<uint32>(layerMaskInfoPos + 4, static_cast<uint32>(layerInfoLength));
+
+		// 統合画像 (白で塗りつぶす)
+		const size_t rowBytes = spec.canvasSize.x * bytesPerChannel;
+		Array<uint8> whiteRow(rowBytes, uint8{0xFF});
+		Array<uint8> packedRow{};
+		packBitsRow(whiteRow.data(), rowBytes, packedRow);
+		writer.value<uint16>(1);
+		for (int32 y = 0; y < spec.canvasSize.y * 3; ++y) writer.value<uint16>(static_cast<uint16>(packedRow.size()));
+		for (int32 y = 0; y < spec.canvasSize.y * 3; ++y) writer.bytes(packedRow.data(), packedRow.size());
+
+		return info;
+	}
+
+# if not SIV3D_PLATFORM(WINDOWS)
+	/// @brief /proc/self/status の項目 (kB 単位) をバイト数で返す
+	int64 readProcStatusBytes(const char* key)
+	{
+		std::FILE* file = std::fopen("/proc/self/status", "r");
+		if (not file) return 0;
+
+		int64 bytes = 0;
+		char line[256];
+		const size_t keyLength = std::strlen(key);
+		while (std::fgets(line, sizeof(line), file))
+		{
+			if (std::strncmp(line, key, keyLength) == 0)
+			{
+				bytes = std::atoll(line + keyLength) * 1024;
+				break;
+			}
+		}
+		std::fclose(file);
+		return bytes;
+	}
+# endif
+
+	/// @brief プロセスの最大使用メモリ (Linux では resetPeakRSS() 以降の値)
+	int64 getPeakRSSBytes()
+	{
+# if SIV3D_PLATFORM(WINDOWS)
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (not ::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return static_cast<int64>(counters.PeakWorkingSetSize);
+# else
+		// getrusage の ru_maxrss は clear_refs で戻らないため、VmHWM を読む
+		if (const int64 bytes = readProcStatusBytes("VmHWM:")) return bytes;
+		rusage usage{};
+		if (::getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+		return static_cast<int64>(usage.ru_maxrss) * 1024;
+# endif
+	}
+
+	/// @brief プロセスの現在の使用メモリ
+	int64 getCurrentRSSBytes()
+	{
+# if SIV3D_PLATFORM(WINDOWS)
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (not ::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return static_cast<int64>(counters.WorkingSetSize);
+# else
+		return readProcStatusBytes("VmRSS:");
+# endif
+	}
+
+	/// @brief 最大使用メモリを現在の値に戻す (Linux のみ)
+	void resetPeakRSS()
+	{
+# if SIV3D_PLATFORM(LINUX)
+		if (std::FILE* file = std::fopen("/proc/self/clear_refs", "w"))
+		{
+			std::fputs("5", file);
+			std::fclose(file);
+		}
+# endif
+	}
+
+	struct BenchmarkResult
+	{
+		double wallSec{};
+		double parseSec{};
+		double firstLayerSec{};
+		int64 peakRSSBytes{};
+
+		/// @brief 読み込み開始時の使用メモリ
+		int64 baselineRSSBytes{};
+
+		ImportStats stats{};
+	};
+
+	BenchmarkResult runImport(const FilePath& path, int32 maxThreads)
+	{
+		BenchmarkResult result{};
+
+		// メタ情報の解析のみの時間
+		{
+			Stopwatch sw{StartImmediately::Yes};
+			const PSDImporter importer{{.filepath = path, .storeTarget = StoreTarget::Image, .maxThreads = maxThreads, .lazyDecode = true}};
+			result.parseSec = sw.sF();
+		}
+
+		resetPeakRSS();
+		result.baselineRSSBytes = getCurrentRSSBytes();
+		Stopwatch sw{StartImmediately::Yes};
+		std::atomic<bool> first{true};
+		std::atomic<double> firstLayerSec{};
+		const PSDImporter importer{
+			{
+				.filepath = path,
+				.storeTarget = StoreTarget::Image,
+				.maxThreads = maxThreads,
+				.onLayerReady = [&](const PSDLayer& layer)
+				{
+					if (not layer.image.isEmpty() && first.exchange(false)) firstLayerSec = sw.sF();
+				},
+				.collectStats = true,
+			}
+		};
+		result.wallSec = sw.sF();
+		result.stats = importer.getImportStats();
+		result.firstLayerSec = firstLayerSec;
+		result.peakRSSBytes = getPeakRSSBytes();
+		return result;
+	}
+}
+
+void Main4()
+{
+	const auto args = System::GetCommandLineArgs();
+	const auto outIt = std::ranges::find(args, U"--out");
+	const FilePath outputPath = (outIt != args.end() && std::next(outIt) != args.end()) ? *std::next(outIt) : U"benchmark.json";
+
+	const FilePath directory = FileSystem::PathAppend(FileSystem::TemporaryDirectoryPath(), U"SivPSDBenchmark");
+	(void)FileSystem::CreateDirectories(directory);
+
+	JSON json{};
+	json[U"hardwareConcurrency"] = static_cast<int32>(std::thread::hardware_concurrency());
+	json[U"iterations"] = benchmarkIterations;
+	Array<JSON> results{};
+
+	for (const auto& spec : benchmarkSpecs)
+	{
+		const FilePath path = FileSystem::PathAppend(directory, spec.name + U".psd");
+		const auto info = writeSyntheticPSD(path, spec);
+		if (not info)
+		{
+			Console.writeln(U"Cannot write {}"_fmt(path));
+			continue;
+		}
+
+		for (const int32 maxThreads : benchmarkThreads)
+		{
+			// 中央値を採る
+			Array<BenchmarkResult> runs{};
+			for (int i = 0; i < benchmarkIterations; ++i) runs.push_back(runImport(path, maxThreads));
+			runs.sort_by([](const BenchmarkResult& a, const BenchmarkResult& b) { return a.wallSec < b.wallSec; });
+			const BenchmarkResult& median = runs[runs.size() / 2];
+
+			JSON entry{};
+			entry[U"scenario"] = spec.name;
+			entry[U"canvasWidth"] = spec.canvasSize.x;
+			entry[U"canvasHeight"] = spec.canvasSize.y;
+			entry[U"layers"] = spec.layerCount;
+			entry[U"sizeSkew"] = spec.sizeSkew;
+			entry[U"compression"] = String{spec.rle ? U"rle" : U"raw"};
+			entry[U"bitsPerChannel"] = spec.bitsPerChannel;
+			entry[U"fileBytes"] = FileSystem::FileSize(path);
+			entry[U"layerPixels"] = info->layerPixels;
+			entry[U"maxThreads"] = maxThreads;
+			entry[U"wallSec"] = median.wallSec;
+			entry[U"parseSec"] = median.parseSec;
+			entry[U"firstLayerSec"] = median.firstLayerSec;
+			entry[U"extractSec"] = median.wallSec - median.parseSec;
+			entry[U"megaPixelsPerSec"] = info->layerPixels / median.wallSec / 1000000.0;
+			entry[U"layersPerSec"] = spec.layerCount / median.wallSec;
+			entry[U"peakRSSBytes"] = median.peakRSSBytes;
+			entry[U"totalSec"] = median.stats.totalSec;
+			entry[U"bytesRead"] = median.stats.bytesRead;
+			entry[U"bytesDecompressed"] = median.stats.bytesDecompressed;
+
+			// 作業用メモリが スレッド数 × 最大のレイヤー に収まっているか
+			// (1レイヤーの作業用メモリは展開したチャンネルと仕上げた画素配列。使用メモリからは元ファイルと格納した画素を除く)
+			const int64 largestLayerBytes = info->largestLayerPixels * (4 * spec.bitsPerChannel / 8 + 4);
+			const int64 scratchBoundBytes = largestLayerBytes * maxThreads;
+			const int64 outputBytes = info->layerPixels * 4;
+			const int64 fileBytes = FileSystem::FileSize(path);
+			size_t peakScratchBytes = 0;
+			for (const auto& thread : median.stats.threads) peakScratchBytes += thread.peakScratchBytes;
+			const int64 scratchRSSBytes = median.peakRSSBytes - median.baselineRSSBytes - outputBytes - fileBytes;
+			entry[U"baselineRSSBytes"] = median.baselineRSSBytes;
+			entry[U"scratchBoundBytes"] = scratchBoundBytes;
+			entry[U"peakScratchBytes"] = static_cast<int64>(peakScratchBytes);
+			entry[U"scratchRSSBytes"] = scratchRSSBytes;
+			entry[U"scratchWithinBound"] = static_cast<int64>(peakScratchBytes) <= scratchBoundBytes
+				&& scratchRSSBytes <= scratchBoundBytes;
+			for (size_t p = 0; p < ImportPhaseCount; ++p)
+			{
+				const auto& phase = median.stats.phases[p];
+				const String name{ToString(static_cast<ImportPhase>(p))};
+				entry[U"phases"][name][U"wallSec"] = phase.wallSec;
+				entry[U"phases"][name][U"threadSec"] = phase.threadSec;
+				entry[U"phases"][name][U"cpuSec"] = phase.cpuSec;
+			}
+
+			Array<JSON> threads{};
+			for (const auto& thread : median.stats.threads)
+			{
+				JSON t{};
+				t[U"threadId"] = thread.threadId;
+				t[U"lifetimeSec"] = thread.lifetimeSec;
+				t[U"busySec"] = thread.busySec;
+				t[U"utilization"] = thread.utilization();
+				t[U"peakScratchBytes"] = static_cast<int64>(thread.peakScratchBytes);
+				threads.push_back(t);
+			}
+			entry[U"threads"] = threads;
+
+			Array<JSON> slowestLayers{};
+			for (const auto& layer : median.stats.slowestLayers)
+			{
+				JSON l{};
+				l[U"id"] = layer.id;
+				l[U"name"] = layer.name;
+				l[U"sec"] = layer.sec;
+				l[U"compressedBytes"] = layer.compressedBytes;
+				slowestLayers.push_back(l);
+			}
+			entry[U"slowestLayers"] = slowestLayers;
+			results.push_back(entry);
+
+			Console.writeln(U"{} threads={}: {:.3f} sec, {:.1f} MPix/s"_fmt(
+				spec.name, maxThreads, median.wallSec, info->layerPixels / median.wallSec / 1000000.0));
+		}
+
+		(void)FileSystem::Remove(path);
+	}
+
+	json[U"results"] = results;
+	if (not json.save(outputPath)) Console.writeln(U"Cannot write {}"_fmt(outputPath));
+	Console.writeln(json.format());
+}